@@ -0,0 +1,282 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <chrono>
+#include <new>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include "httpd_handler.h"
+
+// Microbenchmark of the request parsing and response building of Httpd_handler
+// Requests come from a corpus of captured ones, put straight into the handler's receive buffer, so no socket
+// or syscall is timed, only the code itself
+// Every case reports nanoseconds and operator new calls per request, averaged over the corpus
+
+#define BENCH_DEFAULT_MS 200
+
+static uint64_t allocations = 0;
+
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    allocations++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+    free(p);
+}
+
+// requests as browsers and tools send them
+static const char* corpus[] = {
+        // Chrome
+        "GET /index.html HTTP/1.1\r\n"
+        "Host: 127.0.0.1:8081\r\n"
+        "Connection: keep-alive\r\n"
+        "Cache-Control: max-age=0\r\n"
+        "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+        "sec-ch-ua-mobile: ?0\r\n"
+        "sec-ch-ua-platform: \"Linux\"\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) "
+        "Chrome/118.0.0.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,"
+        "application/signed-exchange;v=b3;q=0.7\r\n"
+        "Sec-Fetch-Site: none\r\n"
+        "Sec-Fetch-Mode: navigate\r\n"
+        "Sec-Fetch-User: ?1\r\n"
+        "Sec-Fetch-Dest: document\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Accept-Language: en-US,en;q=0.9,zh-CN;q=0.8,zh;q=0.7\r\n"
+        "If-None-Match: \"5f2a-18b3c2d4e00\"\r\n"
+        "If-Modified-Since: Tue, 17 Oct 2023 08:12:31 GMT\r\n"
+        "\r\n",
+        // Firefox, with cookies
+        "GET /test.cgi?user=wwd&page=2&sort=desc HTTP/1.1\r\n"
+        "Host: localhost:8081\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Ubuntu; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/118.0\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Referer: http://localhost:8081/index.html\r\n"
+        "Connection: keep-alive\r\n"
+        "Cookie: session=3f9a1c7e2b8d4a6f9e0c1b2a3d4e5f60; theme=dark; _ga=GA1.1.1234567890.1697530000; "
+        "_ga_XYZ=GS1.1.1697530000.1.1.1697530100.0.0.0\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "Sec-Fetch-Dest: document\r\n"
+        "Sec-Fetch-Mode: navigate\r\n"
+        "Sec-Fetch-Site: same-origin\r\n"
+        "Sec-Fetch-User: ?1\r\n"
+        "\r\n",
+        // curl
+        "GET / HTTP/1.1\r\n"
+        "Host: 127.0.0.1:8081\r\n"
+        "User-Agent: curl/8.4.0\r\n"
+        "Accept: */*\r\n"
+        "\r\n",
+        // load generators send the bare minimum
+        "GET /index.html HTTP/1.1\r\n"
+        "Host: 127.0.0.1\r\n"
+        "\r\n",
+        // HTTP/1.0 with keep-alive, like ab
+        "GET /index.html HTTP/1.0\r\n"
+        "Connection: Keep-Alive\r\n"
+        "Host: 127.0.0.1:8081\r\n"
+        "User-Agent: ApacheBench/2.3\r\n"
+        "Accept: */*\r\n"
+        "\r\n",
+        // form submission
+        "POST /test.cgi HTTP/1.1\r\n"
+        "Host: localhost:8081\r\n"
+        "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/118.0\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+        "Accept-Language: en-US,en;q=0.5\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Content-Length: 61\r\n"
+        "Origin: http://localhost:8081\r\n"
+        "Connection: keep-alive\r\n"
+        "Referer: http://localhost:8081/index.html\r\n"
+        "\r\n"
+        "color=red&name=wwd&comment=hello+world&agree=on&submit=Submit",
+        // method the server doesn't implement
+        "DELETE /index.html HTTP/1.1\r\n"
+        "Host: 127.0.0.1:8081\r\n"
+        "User-Agent: python-requests/2.31.0\r\n"
+        "Accept-Encoding: gzip, deflate\r\n"
+        "Accept: */*\r\n"
+        "Connection: keep-alive\r\n"
+        "Content-Length: 0\r\n"
+        "\r\n",
+};
+
+#define CORPUS_SIZE (sizeof(corpus) / sizeof(corpus[0]))
+
+// Puts requests into handlers and times what they do with them
+class Handler_bench {
+private:
+    struct Entry {
+        std::string request;
+        Httpd_handler* handler;
+        // the query string, or the form body, for parse_params
+        Slice params;
+    };
+
+    std::vector<Entry> entries_;
+    long min_ns_;
+
+    static long now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+public:
+    // put request into the receive buffer of handler, as if it had just arrived
+    static void load(Httpd_handler& handler, const std::string& request) {
+        handler.reset_request();
+        if (handler.in_cap_ < request.size()){
+            handler.in_buf_ = (char*) realloc(handler.in_buf_, request.size());
+            handler.in_cap_ = request.size();
+        }
+        memcpy(handler.in_buf_, request.data(), request.size());
+        handler.in_start_ = 0;
+        handler.in_end_ = request.size();
+    }
+
+    // every request of the corpus gets a handler holding it parsed, for the cases timing one step of the parsing
+    explicit Handler_bench(long min_ms) : min_ns_(min_ms * 1000000) {
+        for (const char* request : corpus){
+            Entry entry{request, new Httpd_handler(), Slice{"", 0}};
+            load(*entry.handler, entry.request);
+            entry.handler->next_request();
+            Slice target = entry.handler->parser_.target();
+            const char* query = find_char(target.data, target.data + target.len, '?');
+            if (query != target.data + target.len)
+                entry.params = Slice{query + 1, (size_t) (target.data + target.len - query - 1)};
+            else if (entry.handler->parser_.content_length() > 0)
+                entry.params = Slice{entry.handler->in_buf_ + entry.handler->parser_.head_size(),
+                                     (size_t) entry.handler->parser_.content_length()};
+            entries_.push_back(entry);
+        }
+    }
+
+    Handler_bench(const Handler_bench&) = delete;
+
+    Handler_bench& operator=(const Handler_bench&) = delete;
+
+    ~Handler_bench() {
+        for (Entry& entry : entries_)
+            delete entry.handler;
+    }
+
+    // run step over the corpus, doubling the rounds until they take min_ns_, and report the last run
+    template<typename Step>
+    void run(const char* name, Step step) {
+        uint64_t rounds = 16;
+        while (true){
+            uint64_t allocations_before = allocations;
+            long start = now_ns();
+            for (uint64_t i = 0; i < rounds; i++){
+                for (Entry& entry : entries_)
+                    step(entry);
+            }
+            long elapsed = now_ns() - start;
+            if (elapsed >= min_ns_){
+                double requests = (double) rounds * entries_.size();
+                printf("%-22s %10.1f %12.2f\n", name, elapsed / requests,
+                       (allocations - allocations_before) / requests);
+                return;
+            }
+            rounds *= 2;
+        }
+    }
+
+    void run_all() {
+        printf("%-22s %10s %12s\n", "case", "ns/req", "allocs/req");
+        Http_parser parser(MAX_REQUEST_SIZE);
+        run("Http_parser::parse", [&parser](Entry& entry){
+            parser.reset();
+            parser.parse(entry.request.data(), entry.request.size());
+        });
+        run("next_request", [](Entry& entry){
+            load(*entry.handler, entry.request);
+            entry.handler->next_request();
+        });
+        run("parse_request_line", [](Entry& entry){
+            entry.handler->query_.clear();
+            entry.handler->parse_request_line();
+        });
+        run("parse_header", [](Entry& entry){
+            entry.handler->parse_header();
+        });
+        run("parse_params", [](Entry& entry){
+            entry.handler->params_.clear();
+            entry.handler->parse_params(entry.params, entry.handler->params_);
+        });
+        run("send_head", [](Entry& entry){
+            entry.handler->out_.clear();
+            entry.handler->send_head(STATUS_ID_200, 5120);
+        });
+        run("send_status200", [](Entry& entry){
+            entry.handler->out_.clear();
+            entry.handler->send_status200(5120);
+        });
+        run("send_error400", [](Entry& entry){
+            entry.handler->out_.clear();
+            entry.handler->send_error400();
+        });
+        run("send_error404", [](Entry& entry){
+            entry.handler->out_.clear();
+            entry.handler->send_error404();
+        });
+        run("send_error501", [](Entry& entry){
+            entry.handler->out_.clear();
+            entry.handler->send_error501();
+        });
+    }
+};
+
+int main(int argc, char* argv[]) {
+    long min_ms = BENCH_DEFAULT_MS;
+    int opt;
+    while ((opt = getopt(argc, argv, "m:h")) != -1){
+        switch (opt){
+            case 'm':
+                min_ms = std::max(1L, atol(optarg));
+                break;
+            default:
+                printf("usage: %s [-m ms]\n", argv[0]);
+                printf("  -m ms  least time every case runs for (default %d)\n", BENCH_DEFAULT_MS);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    printf("%zu requests in the corpus\n\n", CORPUS_SIZE);
+    Handler_bench bench(min_ms);
+    bench.run_all();
+    return 0;
+}
@@ -0,0 +1,551 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "http_parser.h"
+#include "httpd_handler.h"
+
+// HTTP load generator for MyHttpd over loopback
+// Every thread runs its own epoll loop over its share of the connections, each connection sends a request,
+// reads the whole response and sends the next one, on the same connection with keep-alive or on a new one
+// Latency is from the first byte sent to the last byte received
+
+#define BENCH_DEFAULT_PORT 8081
+#define BENCH_DEFAULT_SECONDS 5
+#define BENCH_SWEEP_SECONDS 2
+#define BENCH_BUF_SIZE (64 << 10)
+#define BENCH_MAX_EVENTS 256
+// 32 buckets per power of two, every latency is kept to within about 3%
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_BUCKETS (64 * 32)
+
+static long now_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Log-linear histogram of latencies in microseconds, fixed size, so recording never allocates
+// threads keep their own and they are merged at the end
+class Latency_histogram {
+private:
+    uint64_t counts_[HISTOGRAM_BUCKETS] = {};
+    uint64_t total_ = 0;
+
+    static int bucket(uint64_t value) {
+        if (value < (2u << HISTOGRAM_SUB_BITS))
+            return (int) value;
+        int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+        int index = (shift << HISTOGRAM_SUB_BITS) + (int) (value >> shift);
+        return index < HISTOGRAM_BUCKETS ? index : HISTOGRAM_BUCKETS - 1;
+    }
+
+    // the middle of the values in the bucket
+    static uint64_t value(int index) {
+        if (index < (2 << HISTOGRAM_SUB_BITS))
+            return index;
+        int shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+        uint64_t mantissa = (index & ((1 << HISTOGRAM_SUB_BITS) - 1)) + (1 << HISTOGRAM_SUB_BITS);
+        return (mantissa << shift) + ((1ULL << shift) >> 1);
+    }
+
+public:
+    void record(uint64_t us) {
+        counts_[bucket(us)]++;
+        total_++;
+    }
+
+    void merge(const Latency_histogram& other) {
+        for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+            counts_[i] += other.counts_[i];
+        total_ += other.total_;
+    }
+
+    uint64_t total() const { return total_; }
+
+    // q in [0, 1], 0 if nothing was recorded
+    uint64_t percentile(double q) const {
+        if (total_ == 0)
+            return 0;
+        uint64_t rank = (uint64_t) std::ceil(q * total_);
+        if (rank == 0)
+            rank = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < HISTOGRAM_BUCKETS; i++){
+            seen += counts_[i];
+            if (seen >= rank)
+                return value(i);
+        }
+        return value(HISTOGRAM_BUCKETS - 1);
+    }
+};
+
+struct Bench_config {
+    struct sockaddr_in addr{};
+    std::string url = "/";
+    bool keep_alive = true;
+    int connections = 16;
+    int threads = 1;
+    int seconds = BENCH_DEFAULT_SECONDS;
+};
+
+struct Bench_result {
+    Latency_histogram latency;
+    uint64_t requests = 0;
+    uint64_t bytes = 0;
+    // failed connections and reads, and responses other than 2xx
+    uint64_t errors = 0;
+    uint64_t bad_status = 0;
+
+    void merge(const Bench_result& other) {
+        latency.merge(other.latency);
+        requests += other.requests;
+        bytes += other.bytes;
+        errors += other.errors;
+        bad_status += other.bad_status;
+    }
+};
+
+// One client connection and the response it is reading
+struct Bench_connection {
+    int fd = -1;
+    bool connected = false;
+    // bytes of the request sent so far
+    size_t sent = 0;
+    long start = 0;
+    // the response head until it is complete, then how its body ends
+    std::string head;
+    bool head_done = false;
+    int status = 0;
+    bool server_close = false;
+    bool chunked = false;
+    long body_left = -1;
+    Body_reader chunks;
+};
+
+// Runs its share of the connections in its own epoll loop until the deadline
+class Bench_worker {
+private:
+    const Bench_config& config_;
+    std::string request_;
+    std::vector<Bench_connection> connections_;
+    int epoll_fd_;
+    Bench_result result_;
+    char buf_[BENCH_BUF_SIZE];
+
+    bool open_connection(Bench_connection& conn) {
+        conn = Bench_connection();
+        conn.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (conn.fd == -1)
+            return false;
+        int on = 1;
+        setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        if (connect(conn.fd, (const struct sockaddr*) &config_.addr, sizeof(config_.addr)) == -1 &&
+                errno != EINPROGRESS){
+            close(conn.fd);
+            conn.fd = -1;
+            return false;
+        }
+        struct epoll_event event{};
+        event.events = EPOLLOUT;
+        event.data.ptr = &conn;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, conn.fd, &event);
+        conn.start = now_us();
+        return true;
+    }
+
+    // a reset instead of a FIN, so closing thousands of connections a second leaves no TIME_WAIT behind
+    void close_connection(Bench_connection& conn) {
+        struct linger linger{1, 0};
+        setsockopt(conn.fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        close(conn.fd);
+        conn.fd = -1;
+    }
+
+    void reconnect(Bench_connection& conn) {
+        close_connection(conn);
+        if (!open_connection(conn))
+            result_.errors++;
+    }
+
+    void next_request(Bench_connection& conn) {
+        int fd = conn.fd;
+        conn = Bench_connection();
+        conn.fd = fd;
+        conn.connected = true;
+        conn.start = now_us();
+        send_request(conn);
+    }
+
+    void send_request(Bench_connection& conn) {
+        while (conn.sent < request_.size()){
+            ssize_t num_sent = send(conn.fd, request_.data() + conn.sent, request_.size() - conn.sent, MSG_NOSIGNAL);
+            if (num_sent < 0 && errno == EAGAIN){
+                watch(conn, EPOLLOUT);
+                return;
+            }
+            if (num_sent <= 0){
+                result_.errors++;
+                reconnect(conn);
+                return;
+            }
+            conn.sent += num_sent;
+        }
+        watch(conn, EPOLLIN);
+    }
+
+    void watch(Bench_connection& conn, uint32_t events) {
+        struct epoll_event event{};
+        event.events = events;
+        event.data.ptr = &conn;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.fd, &event);
+    }
+
+    // the status line and the headers deciding where the body ends
+    void parse_head(Bench_connection& conn) {
+        const char* p = conn.head.c_str();
+        if (strncmp(p, "HTTP/1.", 7) == 0)
+            conn.status = atoi(p + 9);
+        conn.server_close = strncmp(p, "HTTP/1.0", 8) == 0;
+        while ((p = strstr(p, "\r\n")) != nullptr){
+            p += 2;
+            if (strncasecmp(p, "Content-Length:", 15) == 0)
+                conn.body_left = atol(p + 15);
+            else if (strncasecmp(p, "Transfer-Encoding:", 18) == 0 && strstr(p, "chunked") != nullptr)
+                conn.chunked = true;
+            else if (strncasecmp(p, "Connection:", 11) == 0){
+                const char* value = p + 11;
+                while (*value == ' ')
+                    value++;
+                conn.server_close = strncasecmp(value, "close", 5) == 0;
+            }
+        }
+        if (conn.chunked)
+            conn.chunks.reset(-1, true);
+        // 1xx, 204 and 304 have no body
+        if (conn.status / 100 == 1 || conn.status == 204 || conn.status == 304)
+            conn.body_left = 0;
+    }
+
+    // return true once the response is complete
+    bool take_body(Bench_connection& conn, const char* data, size_t len) {
+        if (conn.chunked){
+            size_t data_len;
+            while (len > 0 && conn.chunks.state() == Body_reader::BODY){
+                size_t framing = conn.chunks.next(data, len, data_len);
+                conn.chunks.consume(data_len);
+                data += framing + data_len;
+                len -= framing + data_len;
+            }
+            return conn.chunks.state() != Body_reader::BODY;
+        }
+        if (conn.body_left < 0)
+            return false;
+        conn.body_left -= std::min((long) len, conn.body_left);
+        return conn.body_left == 0;
+    }
+
+    void read_response(Bench_connection& conn) {
+        while (true){
+            ssize_t num_read = recv(conn.fd, buf_, sizeof(buf_), 0);
+            if (num_read < 0 && errno == EAGAIN)
+                return;
+            // a body without a length ends with the connection
+            if (num_read == 0 && conn.head_done && conn.body_left < 0 && !conn.chunked){
+                complete(conn, true);
+                return;
+            }
+            if (num_read <= 0){
+                result_.errors++;
+                reconnect(conn);
+                return;
+            }
+            result_.bytes += num_read;
+            const char* body = buf_;
+            size_t body_len = num_read;
+            if (!conn.head_done){
+                size_t old_size = conn.head.size();
+                conn.head.append(buf_, num_read);
+                size_t end = conn.head.find("\r\n\r\n", old_size >= 3 ? old_size - 3 : 0);
+                if (end == std::string::npos)
+                    continue;
+                conn.head.resize(end + 4);
+                conn.head_done = true;
+                parse_head(conn);
+                body = buf_ + (end + 4 - old_size);
+                body_len = num_read - (end + 4 - old_size);
+            }
+            if (take_body(conn, body, body_len)){
+                complete(conn, conn.server_close || !config_.keep_alive);
+                return;
+            }
+        }
+    }
+
+    void complete(Bench_connection& conn, bool closed) {
+        result_.latency.record(now_us() - conn.start);
+        result_.requests++;
+        if (conn.status / 100 != 2)
+            result_.bad_status++;
+        if (closed)
+            reconnect(conn);
+        else
+            next_request(conn);
+    }
+
+public:
+    Bench_worker(const Bench_config& config, int connection_nums) : config_(config), connections_(connection_nums) {
+        char host[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &config.addr.sin_addr, host, sizeof(host));
+        request_ = "GET " + config.url + " HTTP/1.1\r\nHost: " + host + "\r\nUser-Agent: httpd_bench\r\n" +
+                   (config.keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    }
+
+    Bench_worker(const Bench_worker&) = delete;
+
+    Bench_worker& operator=(const Bench_worker&) = delete;
+
+    ~Bench_worker() {
+        for (Bench_connection& conn : connections_){
+            if (conn.fd != -1)
+                close_connection(conn);
+        }
+        close(epoll_fd_);
+    }
+
+    void run(long deadline) {
+        for (Bench_connection& conn : connections_){
+            if (!open_connection(conn))
+                result_.errors++;
+        }
+        struct epoll_event events[BENCH_MAX_EVENTS];
+        while (now_us() < deadline){
+            int triggered_nums = epoll_wait(epoll_fd_, events, BENCH_MAX_EVENTS, 100);
+            for (int i = 0; i < triggered_nums; i++){
+                Bench_connection& conn = *(Bench_connection*) events[i].data.ptr;
+                if (conn.fd == -1)
+                    continue;
+                if (!conn.connected){
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    if (err != 0){
+                        result_.errors++;
+                        reconnect(conn);
+                        continue;
+                    }
+                    conn.connected = true;
+                    send_request(conn);
+                }
+                else if (conn.sent < request_.size())
+                    send_request(conn);
+                else
+                    read_response(conn);
+            }
+        }
+    }
+
+    const Bench_result& result() const { return result_; }
+};
+
+// run config.connections connections on config.threads threads for config.seconds
+static Bench_result run_bench(const Bench_config& config, double& elapsed) {
+    int thread_nums = std::max(1, std::min(config.threads, config.connections));
+    std::vector<Bench_worker*> workers;
+    for (int i = 0; i < thread_nums; i++)
+        workers.push_back(new Bench_worker(config, config.connections / thread_nums +
+                                                   (i < config.connections % thread_nums ? 1 : 0)));
+    long start = now_us();
+    long deadline = start + config.seconds * 1000000L;
+    std::vector<std::thread> threads;
+    for (Bench_worker* worker : workers)
+        threads.emplace_back(&Bench_worker::run, worker, deadline);
+    for (std::thread& thread : threads)
+        thread.join();
+    elapsed = (now_us() - start) / 1e6;
+    Bench_result result;
+    for (Bench_worker* worker : workers){
+        result.merge(worker->result());
+        delete worker;
+    }
+    return result;
+}
+
+static std::string format_us(uint64_t us) {
+    char s[32];
+    if (us < 1000)
+        snprintf(s, sizeof(s), "%luus", (unsigned long) us);
+    else if (us < 1000000)
+        snprintf(s, sizeof(s), "%.2fms", us / 1e3);
+    else
+        snprintf(s, sizeof(s), "%.2fs", us / 1e6);
+    return s;
+}
+
+static void print_header() {
+    printf("%-6s %6s  %-22s %10s %10s %9s %9s %9s %8s\n",
+           "mode", "conns", "url", "req/s", "MB/s", "p50", "p99", "p999", "errors");
+}
+
+static void print_result(const Bench_config& config, const Bench_result& result, double elapsed) {
+    printf("%-6s %6d  %-22s %10.1f %10.1f %9s %9s %9s %8lu\n",
+           config.keep_alive ? "keep" : "close", config.connections, config.url.c_str(),
+           result.requests / elapsed, result.bytes / elapsed / (1 << 20),
+           format_us(result.latency.percentile(0.50)).c_str(),
+           format_us(result.latency.percentile(0.99)).c_str(),
+           format_us(result.latency.percentile(0.999)).c_str(),
+           (unsigned long) (result.errors + result.bad_status));
+    fflush(stdout);
+}
+
+// files of the sweep, created in the document root for the run and removed after it
+static const struct {
+    const char* name;
+    long size;
+} sweep_files[] = {
+        {"/bench_1k.bin", 1L << 10},
+        {"/bench_64k.bin", 64L << 10},
+        {"/bench_1m.bin", 1L << 20},
+        {"/bench_100m.bin", 100L << 20},
+};
+
+static bool create_file(const std::string& path, long size) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1)
+        return false;
+    std::vector<char> block(BENCH_BUF_SIZE, 'x');
+    for (long left = size; left > 0;){
+        ssize_t num_written = write(fd, block.data(), std::min(left, (long) block.size()));
+        if (num_written <= 0){
+            close(fd);
+            return false;
+        }
+        left -= num_written;
+    }
+    close(fd);
+    return true;
+}
+
+// keep-alive and close, 1, 16 and 128 connections, static files from 1KB to 100MB and the CGI
+static int sweep(Bench_config config, const std::string& docroot) {
+    for (auto& file : sweep_files){
+        if (!create_file(docroot + file.name, file.size)){
+            perror("ERROR: create bench file failed\n");
+            return 1;
+        }
+    }
+    std::vector<std::string> urls;
+    for (auto& file : sweep_files)
+        urls.emplace_back(file.name);
+    urls.emplace_back("/test.cgi");
+
+    print_header();
+    for (bool keep_alive : {true, false}){
+        for (int connections : {1, 16, 128}){
+            for (const std::string& url : urls){
+                config.keep_alive = keep_alive;
+                config.connections = connections;
+                config.url = url;
+                double elapsed;
+                Bench_result result = run_bench(config, elapsed);
+                print_result(config, result, elapsed);
+            }
+        }
+    }
+    for (auto& file : sweep_files)
+        unlink((docroot + file.name).c_str());
+    return 0;
+}
+
+static void usage(const char* name) {
+    printf("usage: %s [-a addr] [-p port] [-u url] [-c connections] [-t threads] [-d seconds] [-k] [-s [-r docroot]]\n",
+           name);
+    printf("  -a addr         server address (default 127.0.0.1)\n");
+    printf("  -p port         server port (default %d)\n", BENCH_DEFAULT_PORT);
+    printf("  -u url          path to request (default /)\n");
+    printf("  -c connections  concurrent connections (default 16)\n");
+    printf("  -t threads      client threads, each with its own epoll (default one per core, at most 4)\n");
+    printf("  -d seconds      duration of a run (default %d, %d per run of a sweep)\n",
+           BENCH_DEFAULT_SECONDS, BENCH_SWEEP_SECONDS);
+    printf("  -k              a new connection for every request instead of keep-alive\n");
+    printf("  -s              sweep keep-alive and close, 1/16/128 connections, 1KB-100MB files and the CGI\n");
+    printf("  -r docroot      where the sweep puts its files, the server's document root (default %s)\n", HTDOCS_PATH);
+}
+
+int main(int argc, char* argv[]) {
+    Bench_config config;
+    config.addr.sin_family = AF_INET;
+    config.addr.sin_port = htons(BENCH_DEFAULT_PORT);
+    config.addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    config.threads = std::max(1, std::min(4, (int) std::thread::hardware_concurrency()));
+    bool sweeping = false;
+    bool seconds_set = false;
+    std::string docroot = HTDOCS_PATH;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:u:c:t:d:ksr:h")) != -1){
+        switch (opt){
+            case 'a':
+                if (inet_pton(AF_INET, optarg, &config.addr.sin_addr) != 1){
+                    fprintf(stderr, "ERROR: bad address %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'p':
+                config.addr.sin_port = htons((u_short) atoi(optarg));
+                break;
+            case 'u':
+                config.url = optarg;
+                break;
+            case 'c':
+                config.connections = std::max(1, atoi(optarg));
+                break;
+            case 't':
+                config.threads = std::max(1, atoi(optarg));
+                break;
+            case 'd':
+                config.seconds = std::max(1, atoi(optarg));
+                seconds_set = true;
+                break;
+            case 'k':
+                config.keep_alive = false;
+                break;
+            case 's':
+                sweeping = true;
+                break;
+            case 'r':
+                docroot = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (sweeping){
+        if (!seconds_set)
+            config.seconds = BENCH_SWEEP_SECONDS;
+        return sweep(config, docroot);
+    }
+    double elapsed;
+    Bench_result result = run_bench(config, elapsed);
+    print_header();
+    print_result(config, result, elapsed);
+    printf("\n%lu requests in %.2fs, %lu errors, %lu responses other than 2xx\n",
+           (unsigned long) result.requests, elapsed, (unsigned long) result.errors, (unsigned long) result.bad_status);
+    return 0;
+}
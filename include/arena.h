@@ -0,0 +1,49 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <cstddef>
+#include <cstdarg>
+
+#ifndef MYHTTPD_ARENA_H
+#define MYHTTPD_ARENA_H
+
+#define ARENA_BLOCK_SIZE 4096
+
+// Bump allocator for memory that lives exactly as long as one request
+// Nothing is freed one by one, reset() gives everything back at once
+// The first block is kept across resets, so a connection usually allocates it once in its lifetime
+class Arena {
+private:
+    struct Block {
+        Block* next;
+        size_t size;
+    };
+
+    // first block is kept, later blocks are chained behind it and freed by reset()
+    Block* first_;
+    Block* current_;
+    size_t used_;
+
+    Block* new_block(size_t size);
+
+    static char* data(Block* block) { return (char*) (block + 1); }
+
+public:
+    Arena();
+
+    Arena(const Arena&) = delete;
+
+    Arena& operator=(const Arena&) = delete;
+
+    ~Arena();
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t));
+
+    // printf into arena memory, the result is NUL-terminated
+    char* format(const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+    void reset();
+};
+
+#endif //MYHTTPD_ARENA_H
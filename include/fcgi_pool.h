@@ -0,0 +1,99 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <functional>
+#include <unistd.h>
+#include <sys/types.h>
+#include "timer_wheel.h"
+
+#ifndef MYHTTPD_FCGI_POOL_H
+#define MYHTTPD_FCGI_POOL_H
+
+// worker processes per script, and requests waiting for one of them
+#define FCGI_DEFAULT_WORKERS 4
+#define FCGI_QUEUE_SIZE 256
+// seconds a worker has for one request
+#define FCGI_TIMEOUT 30
+
+// FastCGI record types and roles, see the FastCGI 1.0 specification
+#define FCGI_VERSION_1 1
+#define FCGI_HEADER_LEN 8
+#define FCGI_BEGIN_REQUEST 1
+#define FCGI_END_REQUEST 3
+#define FCGI_PARAMS 4
+#define FCGI_STDIN 5
+#define FCGI_STDOUT 6
+#define FCGI_STDERR 7
+#define FCGI_RESPONDER 1
+#define FCGI_KEEP_CONN 1
+#define FCGI_REQUEST_ID 1
+
+// One long-lived FastCGI process and our connection to it
+// A worker serves one request at a time, so every request uses FCGI_REQUEST_ID
+struct Fcgi_worker {
+    std::string path;
+    pid_t pid = -1;
+    int fd = -1;
+    // FCGI_TIMEOUT of the request it is serving, expiring shuts fd down
+    Timer timer;
+};
+
+// Process-wide pool of FastCGI workers, a few per .fcgi script, started on the first request for it
+// A worker is started the way FastCGI expects: its stdin is a listening Unix socket, and we are its only client
+// Requests beyond the workers wait in a queue and get the next worker released, a full queue is refused
+class Fcgi_pool {
+public:
+    typedef std::function<void(Fcgi_worker*)> Waiter;
+
+private:
+    struct Script {
+        std::vector<Fcgi_worker*> idle;
+        std::deque<Waiter> waiting;
+        // workers started and not discarded, idle or busy
+        size_t worker_nums = 0;
+    };
+
+    std::mutex mutex_;
+    size_t max_workers_;
+    std::map<std::string, Script> scripts_;
+    unsigned long spawned_;
+
+    Fcgi_pool();
+
+    Fcgi_worker* spawn(const std::string& path);
+
+    static void discard(Fcgi_worker* worker);
+
+public:
+    Fcgi_pool(const Fcgi_pool&) = delete;
+
+    Fcgi_pool& operator=(const Fcgi_pool&) = delete;
+
+    static Fcgi_pool& instance();
+
+    // workers per script, 0 runs .fcgi scripts as plain CGI
+    void set_max_workers(size_t max_workers);
+
+    bool enabled();
+
+    // true if worker is set right away, to nullptr if the queue is full or no worker could be started
+    // false if all workers are busy, waiter gets a worker later, called by the thread releasing it
+    bool acquire(const std::string& path, Fcgi_worker*& worker, const Waiter& waiter);
+
+    // reusable is false if the worker's connection is in an unknown state, it is killed then
+    void release(Fcgi_worker* worker, bool reusable);
+};
+
+// append a FastCGI record, content longer than a record can hold is split over several
+void fcgi_record(std::string& out, int type, const char* content, size_t len);
+
+// append a name-value pair of FCGI_PARAMS content
+void fcgi_param(std::string& out, const char* name, const char* value, size_t value_len);
+
+#endif //MYHTTPD_FCGI_POOL_H
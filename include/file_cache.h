@@ -0,0 +1,83 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <map>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#ifndef MYHTTPD_FILE_CACHE_H
+#define MYHTTPD_FILE_CACHE_H
+
+#define FILE_CACHE_DEFAULT_SIZE (32 << 20)
+#define FILE_CACHE_MAX_ENTRY (1 << 20)
+
+// Process-wide LRU cache of small static files, keyed by the resolved file path
+// Every entry holds the preassembled response header and the file content, so a hit needs no filesystem access
+// Directories of cached files are watched with inotify, a background thread drops entries whose file changed
+class File_cache {
+public:
+    struct Entry {
+        std::string header;
+        std::string body;
+    };
+
+private:
+    typedef std::list<std::string> Lru_list;
+    struct Node {
+        std::shared_ptr<const Entry> entry;
+        Lru_list::iterator lru_pos;
+    };
+
+    std::mutex mutex_;
+    size_t capacity_;
+    size_t used_;
+    // most recently used path at the front
+    Lru_list lru_;
+    std::unordered_map<std::string, Node> entries_;
+    // bumped by every invalidation, a fill that started before it must not be inserted
+    uint64_t generation_;
+
+    // inotify
+    int inotify_fd_;
+    // a directory can be reached through several paths, so one watch may stand for several of them
+    std::map<int, std::vector<std::string>> watch_dirs_;
+    std::unordered_map<std::string, int> dir_watches_;
+
+    File_cache();
+
+    void evict(size_t needed);
+
+    void erase(const std::string& path);
+
+    void erase_dir(const std::string& dir);
+
+    bool watch_dir(const std::string& dir);
+
+    void watch_loop();
+
+public:
+    File_cache(const File_cache&) = delete;
+
+    File_cache& operator=(const File_cache&) = delete;
+
+    static File_cache& instance();
+
+    // byte budget for header and body of all entries, 0 disables the cache
+    void set_capacity(size_t capacity);
+
+    bool cacheable(size_t file_size);
+
+    std::shared_ptr<const Entry> get(const std::string& path);
+
+    uint64_t watch(const std::string& path);
+
+    void put(const std::string& path, const std::shared_ptr<const Entry>& entry, uint64_t generation);
+};
+
+#endif //MYHTTPD_FILE_CACHE_H
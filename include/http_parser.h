@@ -0,0 +1,217 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <strings.h>
+#include <cctype>
+#include <algorithm>
+
+#ifndef MYHTTPD_HTTP_PARSER_H
+#define MYHTTPD_HTTP_PARSER_H
+
+#define MAX_HEADER_NUMS 64
+#define MAX_PARAM_NUMS 32
+
+// Header fields the server looks at, found by id instead of comparing names
+enum Header_id {
+    HEADER_UNKNOWN = 0,
+    HEADER_ACCEPT,
+    HEADER_ACCEPT_ENCODING,
+    HEADER_CONNECTION,
+    HEADER_CONTENT_LENGTH,
+    HEADER_CONTENT_TYPE,
+    HEADER_COOKIE,
+    HEADER_EXPECT,
+    HEADER_HOST,
+    HEADER_HTTP2_SETTINGS,
+    HEADER_IF_MODIFIED_SINCE,
+    HEADER_IF_NONE_MATCH,
+    HEADER_IF_RANGE,
+    HEADER_RANGE,
+    HEADER_REFERER,
+    HEADER_TRANSFER_ENCODING,
+    HEADER_UPGRADE,
+    HEADER_USER_AGENT,
+    HEADER_ID_NUMS
+};
+
+// case-insensitive, HEADER_UNKNOWN for names not in the list
+Header_id header_id(const char* name, size_t len);
+
+// A view of bytes owned by someone else, valid as long as they stay where they are
+struct Slice {
+    const char* data;
+    size_t len;
+
+    bool empty() const { return len == 0; }
+
+    bool equals(const char* s) const { return strlen(s) == len && memcmp(data, s, len) == 0; }
+
+    bool equals_nocase(const char* s) const { return strlen(s) == len && strncasecmp(data, s, len) == 0; }
+
+    std::string str() const { return std::string(data, len); }
+
+    // whether this comma-separated list, like a Connection header, has token in it, case-insensitive
+    bool has_token(const char* token) const;
+};
+
+// name=value pairs of a query string or a form body, slices into the request
+class Param_list {
+private:
+    Slice names_[MAX_PARAM_NUMS];
+    Slice values_[MAX_PARAM_NUMS];
+    int nums_ = 0;
+
+public:
+    void clear() { nums_ = 0; }
+
+    // pairs beyond MAX_PARAM_NUMS are dropped
+    void add(Slice name, Slice value);
+
+    int size() const { return nums_; }
+
+    Slice name(int i) const { return names_[i]; }
+
+    Slice value(int i) const { return values_[i]; }
+
+    // data is nullptr if there is no such name
+    Slice find(const char* name) const;
+};
+
+// Incremental HTTP/1.x request head parser
+// parse() can be called again whenever more bytes arrive, it resumes where it stopped and never looks at a byte twice
+// Nothing is copied or allocated, the results are offsets into the caller's buffer
+class Http_parser {
+public:
+    enum State {
+        NEED_MORE,
+        DONE,
+        ERROR
+    };
+
+private:
+    struct Span {
+        uint32_t off;
+        uint32_t len;
+    };
+    struct Header {
+        Span name;
+        Span value;
+        Header_id id;
+    };
+
+    State state_;
+    // where the next line starts and how far it has been scanned for its end
+    size_t line_start_;
+    size_t scanned_;
+    size_t head_size_;
+    size_t max_head_size_;
+    const char* base_;
+
+    Span method_, target_, version_;
+    Header headers_[MAX_HEADER_NUMS];
+    int header_nums_;
+    // index in headers_ of the first header of every id, -1 if there is none
+    int8_t header_index_[HEADER_ID_NUMS];
+    long content_length_;
+
+    bool parse_request_line(size_t start, size_t end);
+
+    bool parse_header_line(size_t start, size_t end);
+
+    Slice slice(const Span& span) const { return Slice{base_ + span.off, span.len}; }
+
+public:
+    explicit Http_parser(size_t max_head_size);
+
+    void reset();
+
+    // buf holds the request from its first byte, with the same bytes as the last call plus the new ones
+    // it may have moved in memory since the last call
+    State parse(const char* buf, size_t len);
+
+    State state() const { return state_; }
+
+    // bytes taken by the request line, the headers and the blank line
+    size_t head_size() const { return head_size_; }
+
+    // -1 if there is no Content-Length header
+    long content_length() const { return content_length_; }
+
+    // results below point into the buffer of the last parse() call
+    Slice method() const { return slice(method_); }
+
+    Slice target() const { return slice(target_); }
+
+    Slice version() const { return slice(version_); }
+
+    int header_nums() const { return header_nums_; }
+
+    Slice header_name(int i) const { return slice(headers_[i].name); }
+
+    Slice header_value(int i) const { return slice(headers_[i].value); }
+
+    // O(1), data is nullptr if there is no such header
+    Slice header(Header_id id) const;
+
+    // any header name, case-insensitive
+    Slice header(const char* name) const;
+};
+
+// Incremental decoder of a request body framed by Content-Length or by the chunked transfer coding
+// Like Http_parser it copies nothing, next() steps over framing and tells how many body bytes follow in the
+// caller's buffer, the caller takes as many of them as it can and reports them with consume()
+class Body_reader {
+public:
+    enum State {
+        BODY,
+        DONE,
+        ERROR
+    };
+
+private:
+    enum Step {
+        LENGTH,
+        CHUNK_SIZE,
+        CHUNK_EXT,
+        CHUNK_SIZE_LF,
+        CHUNK_DATA,
+        CHUNK_DATA_CR,
+        CHUNK_DATA_LF,
+        TRAILER,
+        TRAILER_LINE,
+        TRAILER_LF
+    };
+
+    State state_ = DONE;
+    Step step_ = LENGTH;
+    // body bytes left in the body or in the current chunk, and the hex digits of a chunk size so far
+    uint64_t left_ = 0;
+    int digits_ = 0;
+    uint64_t received_ = 0;
+
+public:
+    // no body at all when content_length < 0 and not chunked
+    void reset(long content_length, bool chunked);
+
+    // return the framing bytes at the start of [p, p + len) it stepped over
+    // data_len is the number of body bytes right behind them, 0 if more input is needed or the body is over
+    size_t next(const char* p, size_t len, size_t& data_len);
+
+    // n of the data_len bytes from next() were taken
+    void consume(size_t n);
+
+    State state() const { return state_; }
+
+    // body bytes taken so far
+    uint64_t received() const { return received_; }
+};
+
+// SIMD scan for c in [p, end), return end if it is not there
+const char* find_char(const char* p, const char* end, char c);
+
+#endif //MYHTTPD_HTTP_PARSER_H
@@ -0,0 +1,110 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <ctime>
+#include <cstddef>
+#include <cstdint>
+#include "http_parser.h"
+
+#ifndef MYHTTPD_HTTP_RESPONSE_H
+#define MYHTTPD_HTTP_RESPONSE_H
+
+#define STATUS_100 "HTTP/1.1 100 Continue\r\n\r\n"
+#define STATUS_200 "HTTP/1.1 200 OK\r\n"
+#define STATUS_302 "HTTP/1.1 302 Found\r\n"
+#define STATUS_400 "HTTP/1.1 400 BAD REQUEST\r\n"
+#define STATUS_404 "HTTP/1.1 404 NOT FOUND\r\n"
+#define STATUS_413 "HTTP/1.1 413 Payload Too Large\r\n"
+#define STATUS_500 "HTTP/1.1 500 Internal Server Error\r\n"
+#define STATUS_501 "HTTP/1.1 501 Method Not Implemented\r\n"
+#define STATUS_502 "HTTP/1.1 502 Bad Gateway\r\n"
+#define STATUS_503 "HTTP/1.1 503 Service Unavailable\r\n"
+#define STATUS_504 "HTTP/1.1 504 Gateway Timeout\r\n"
+#define SERVER_STRING "Server: httpd++/1.0.0\r\n"
+// room for the headers put together per response: Date, Content-Type, Content-Length, Connection
+#define HEADER_TAIL_SIZE 256
+
+// length of a string literal, known at compile time
+#define LITERAL_LEN(s) (sizeof(s) - 1)
+#define LITERAL_SLICE(s) Slice{s, LITERAL_LEN(s)}
+
+// Statuses the server answers with on its own, indexes into http_statuses
+enum Status_id {
+    STATUS_ID_200 = 0,
+    STATUS_ID_302,
+    STATUS_ID_400,
+    STATUS_ID_404,
+    STATUS_ID_413,
+    STATUS_ID_500,
+    STATUS_ID_501,
+    STATUS_ID_502,
+    STATUS_ID_503,
+    STATUS_ID_504,
+    STATUS_ID_NUMS
+};
+
+// The constant part of a response: the status line with the Server header, and the canned page of an error
+struct Http_status {
+    int code;
+    Slice head;
+    Slice page;
+};
+
+#define HTTP_STATUS(code, line, page) {code, LITERAL_SLICE(line SERVER_STRING), LITERAL_SLICE(page)}
+
+// built at compile time, nothing is formatted or measured when a response is sent
+constexpr Http_status http_statuses[STATUS_ID_NUMS] = {
+        HTTP_STATUS(200, STATUS_200, ""),
+        HTTP_STATUS(302, STATUS_302, ""),
+        HTTP_STATUS(400, STATUS_400,
+                    "<P>Your browser sent a bad request, "
+                    "such as a POST without a Content-Length.\r\n"),
+        HTTP_STATUS(404, STATUS_404,
+                    "<HTML><TITLE>Not Found</TITLE>\r\n"
+                    "<BODY><P>The server could not fulfill\r\n"
+                    "your request because the resource specified\r\n"
+                    "is unavailable or nonexistent.\r\n"
+                    "</BODY></HTML>\r\n"),
+        HTTP_STATUS(413, STATUS_413,
+                    "<P>The request body is too large.\r\n"),
+        HTTP_STATUS(500, STATUS_500,
+                    "<P>Server Error.\r\n"),
+        HTTP_STATUS(501, STATUS_501,
+                    "<HTML><HEAD><TITLE>Method Not Implemented\r\n"
+                    "</TITLE></HEAD>\r\n"
+                    "<BODY><P>HTTP request method not supported.\r\n"
+                    "</BODY></HTML>\r\n"),
+        HTTP_STATUS(502, STATUS_502,
+                    "<P>The CGI worker failed.\r\n"),
+        HTTP_STATUS(503, STATUS_503,
+                    "<P>Too many requests are waiting, try again later.\r\n"),
+        HTTP_STATUS(504, STATUS_504,
+                    "<P>The CGI worker took too long.\r\n"),
+};
+
+static_assert(http_statuses[STATUS_ID_504].code == 504, "http_statuses is out of step with Status_id");
+
+constexpr const Http_status& http_status(Status_id id) {
+    return http_statuses[id];
+}
+
+// STATUS_ID_NUMS if code is not in the table
+constexpr Status_id status_id(int code, int i = 0) {
+    return i == STATUS_ID_NUMS || http_statuses[i].code == code ? (Status_id) i : status_id(code, i + 1);
+}
+
+// "Date: <IMF-fixdate>\r\n" of the current second
+// every thread keeps its own copy and formats it again only when the second has changed
+Slice date_header();
+
+// write the decimal digits of n at p, return the end of them
+char* put_decimal(char* p, uint64_t n);
+
+// copy s to p, return the end of it
+inline char* put_slice(char* p, Slice s) {
+    memcpy(p, s.data, s.len);
+    return p + s.len;
+}
+
+#endif //MYHTTPD_HTTP_RESPONSE_H
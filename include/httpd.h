@@ -3,16 +3,29 @@
 //
 
 #include <fcntl.h>
-#include <sys/mman.h>
+#include <signal.h>
 #include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <poll.h>
+#include <netinet/tcp.h>
 #include "httpd_handler.h"
+#include "thread_pool.h"
+#include "io_uring.h"
 
 #ifndef MYHTTPD_HTTPD_H
 #define MYHTTPD_HTTPD_H
 
 #define SOCKET_QUEUE_SIZE 20
 #define EPOLL_FD_SIZE 256
-#define BUFFER_SIZE 256
+#define HANDLER_POOL_SIZE 1024
+// set in the epoll data of the epoll fds CGIs wait on, above the 32 bits of the fd
+#define CGI_EVENT_TAG (1ULL << 32)
+// kinds of io_uring requests, in user_data above the fd the same way, compared as a whole with the fd masked off
+#define URING_ACCEPT_TAG (2ULL << 32)
+#define URING_TIMER_TAG (3ULL << 32)
+#define URING_RECV_TAG (4ULL << 32)
+#define URING_POLL_TAG (5ULL << 32)
+#define URING_EVENT_SIZE 256
 
 class Httpd{
 private:
@@ -20,32 +33,92 @@ private:
     // variables for epoll
     int epoll_fd_;
     struct epoll_event event_, event_list_[SOCKET_QUEUE_SIZE];
+    // record_ is shared by the epoll loop and the workers
     std::map<int, Httpd_handler*> record_;
+    std::mutex record_mutex_;
+    // handlers of closed connections waiting for the next accept, guarded by record_mutex_ too
+    std::vector<Httpd_handler*> free_handlers_;
+    // epoll fds of running CGIs and their connections, guarded by record_mutex_ too
+    std::map<int, Httpd_handler*> cgi_record_;
+    // timeouts of the connections waiting for their client, guarded by record_mutex_ too
+    // timer_fd_ ticks once a second while any timer is armed, and not at all otherwise
+    Timer_wheel timers_;
+    int timer_fd_;
+    std::vector<int> expired_;
+    // workers running Httpd_handler's parsing and responding
+    // nullptr means the loop thread handles requests by itself
+    Thread_pool* pool_;
+    // the io_uring backend, nullptr when this reactor runs on epoll
+    Io_uring* uring_;
+    Uring_event uring_events_[URING_EVENT_SIZE];
+    // multishot accept stopped on an error like EMFILE, it is armed again with the next tick
+    bool accept_paused_;
+    static bool use_uring_;
 public:
-    Httpd();
+    // worker_nums == 0 means no pool, the loop thread handles requests by itself
+    explicit Httpd(int worker_nums);
+
+    Httpd(const Httpd&) = delete;
+
+    Httpd& operator=(const Httpd&) = delete;
 
     ~Httpd();
 
     // HTTPD RUN
     void start_up(u_short port);
 
+    static void start_up_reactors(u_short port, int reactor_nums, int worker_nums);
+
+    // use io_uring where the kernel supports it, epoll otherwise, set before set_up()
+    static void set_io_uring(bool on);
+
+    u_short set_up(u_short port, bool reuse_port);
+
     void loop();
 
+    void uring_loop();
+
     void accept_connection();
 
+    void open_connection(int client_socket, struct sockaddr_in& client_addr);
+
+    void uring_accepted(const Uring_event& event);
+
+    void read_received(int client_socket, const Uring_event& event);
+
     void read_request(int& client_socket);
 
     void response_request(int& client_socket);
 
-    void wait_for_child(int& pid, int& status);
+    void relay_cgi(int cgi_epoll);
+
+    void respond(Httpd_handler* handler);
+
+    void wait_for_cgi(Httpd_handler* handler, bool output_blocked);
+
+    void forget_cgi(Httpd_handler* handler);
+
+    bool assign_fcgi_worker(Httpd_handler* handler);
+
+    void dispatch(std::function<void()> task);
+
+    void close_connection(int client_socket);
+
+    void modify_event(int socket, int op, uint32_t events);
+
+    void set_timer(Httpd_handler* handler, long expire);
+
+    void cancel_timer(Httpd_handler* handler);
+
+    void wait_for_request(Httpd_handler* handler);
 
-    void sent_to_parent(char* p, Httpd_handler* handler);
+    void set_tick(bool on);
 
-    void recv_from_child(char *p, char buffer[MAX_BUF_SIZE]);
+    void close_expired_connections();
 
-    void modify_event(int& socket, int op, uint32_t events);
+    Httpd_handler* get_handler(int& client_socket, struct sockaddr_in& client_addr);
 
-    Httpd_handler* get_handler(int& client_socket);
+    Httpd_handler* find_handler(int client_socket);
 };
 
 
@@ -3,76 +3,211 @@
 //
 
 #include <map>
+#include <ctime>
+#include <atomic>
 #include <fstream>
 #include <iostream>
 #include <cstring>
 #include <vector>
 #include <string>
 #include <wait.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <signal.h>
+#include "file_cache.h"
 #include <unistd.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <algorithm>
+#include "http_parser.h"
+#include "http_response.h"
+#include "metrics.h"
+#include "logger.h"
+#include "arena.h"
+#include "timer_wheel.h"
+#include "output_queue.h"
+#include "fcgi_pool.h"
 
 #ifndef MYHTTPD_Httpd_handler_H
 #define MYHTTPD_Httpd_handler_H
 
+#define STDIN 0
 #define STDOUT 1
 #define MAX_BUF_SIZE 1024
-#define STATUS_200 "HTTP/1.0 200 OK\r\n"
-#define STATUS_400 "HTTP/1.0 400 BAD REQUEST\r\n"
-#define STATUS_404 "HTTP/1.0 404 NOT FOUND\r\n"
-#define STATUS_500 "HTTP/1.0 500 Internal Server Error\r\n"
-#define STATUS_501 "HTTP/1.0 501 Method Not Implemented\r\n"
-#define SERVER_STRING "Server: httpd++/1.0.0\r\n"
+#define MAX_REQUEST_SIZE 8192
+// default limit of a request body, and the room a body streamed to a CGI passes through
+#define MAX_BODY_SIZE (16L << 20)
+#define BODY_BUF_SIZE (64 << 10)
+// seconds an idle connection is kept, a request has from its first byte to its last, and a send may stall
+#define KEEP_ALIVE_TIMEOUT 5
+#define REQUEST_TIMEOUT 10
+#define WRITE_TIMEOUT 10
+#define KEEP_ALIVE_MAX_REQUESTS 100
+#define HTDOCS_PATH "/home/wwd/CLionProjects/MyHttpd/htdocs"
 
 class Httpd_handler {
+    // the microbenchmark drives the parsing and response building without a socket
+    friend class Handler_bench;
+
+public:
+    // what relay_cgi() did, and what the connection waits for next
+    enum Cgi_state {
+        CGI_MORE,
+        CGI_WAIT,
+        CGI_DONE
+    };
+
 private:
     // socket
     int client_fd_;
     struct sockaddr_in client_addr_{};
 
+    // everything received and not yet served, may hold several pipelined requests
+    // the current request starts at in_start_, received data ends at in_end_
+    char* in_buf_ = nullptr;
+    size_t in_cap_ = 0, in_start_ = 0, in_end_ = 0;
+    // the body of the current request follows its head, body_pos_ is where its next undecoded byte is
+    Body_reader body_;
+    size_t body_pos_ = 0;
+    static long max_body_;
+
     // used to parse http msg's first line and its head
-    std::string buffer_str_;
-    std::vector<std::string> buffer_byline_;
+    Http_parser parser_{MAX_REQUEST_SIZE};
 
-    // parse result
-    std::string method_, url_, ver_;
-    std::map<std::string, std::string> header_, query_, params_;
+    // parse result, slices into in_buf_
+    Slice method_{"", 0}, url_{"", 0}, ver_{"", 0};
+    // header fields are kept by parser_, query and form parameters point into in_buf_ as well
+    Param_list query_, params_;
 
-    // web
+    // web, the file path keeps its capacity across requests
     std::string path_;
 
+    // scratch memory of the current request: response headers, CGI environment
+    Arena arena_;
+
+    // persistent connection
+    bool bad_request_ = false;
+    bool too_large_ = false;
+    bool keep_alive_ = false;
+    // a complete request is parsed and waits for its response
+    bool request_ready_ = false;
+    // the last response asked for the connection to be closed once it is sent
+    bool closing_ = false;
+    int served_nums_ = 0;
+    // when the first byte of the request being received arrived, 0 if nothing has arrived yet
+    long request_start_ = 0;
+    // Metrics::now_ns() when the oldest request without a response byte sent was parsed, 0 if there is none
+    uint64_t parsed_ns_ = 0;
+    // status of the response to the current request, and out_.appended() when it started, for the access log
+    int status_code_ = 0;
+    uint64_t response_mark_ = 0;
+    // keep-alive, request or write timeout, armed by Httpd while the connection waits for the client
+    Timer timer_;
+
+    // responses waiting for the client to read them
+    Output_queue out_;
+
+    // output pipe and pid of the running CGI child, -1 if there is none
+    int cgi_fd_ = -1;
+    pid_t cgi_pid_ = -1;
+    // the child's stdin pipe, while the body is passed on, and whether it was full at the last try
+    int cgi_in_fd_ = -1;
+    bool cgi_in_open_ = false;
+    bool cgi_in_blocked_ = false;
+    // the body can't be passed on, the child is stopped
+    bool cgi_abort_ = false;
+    // a CGI waits for its output, its stdin and the client at once, Httpd watches this epoll fd of all of them
+    // watch_* are the events each of them is watched for now
+    int cgi_epoll_ = -1;
+    uint32_t watch_out_ = 0, watch_in_ = 0, watch_client_ = 0;
+    // the child's output until its header block is complete, and how its body is framed
+    std::string cgi_head_;
+    bool cgi_head_done_ = false;
+    bool cgi_chunked_ = false;
+    // a .fcgi request waiting for a worker, the worker serving it, and its records not parsed yet
+    bool fcgi_wait_ = false;
+    Fcgi_worker* fcgi_worker_ = nullptr;
+    std::string fcgi_in_;
+    // FCGI_STDIN records not fully sent yet
+    std::string fcgi_out_;
+    // FCGI_END_REQUEST arrived, the worker can take the next request
+    bool fcgi_ended_ = false;
+
 public:
     // INIT SOCKET
     Httpd_handler();
 
     Httpd_handler(int& fd, struct sockaddr_in& addr);
 
-    Httpd_handler(const Httpd_handler& copy);
+    // the handler owns its receive buffer and parse results point into it, so it can't be copied
+    Httpd_handler(const Httpd_handler& copy) = delete;
+
+    Httpd_handler& operator=(const Httpd_handler& copy) = delete;
 
     ~Httpd_handler();
 
+    void open_connection(int fd, struct sockaddr_in& addr);
+
     void close_socket() const;
 
-    inline void reset();
+    void reset();
+
+    // largest request body taken, larger ones get 413
+    static void set_max_body(long size);
 
     // GET AND ANALYSE REQUEST
-    void receive_request();
+    bool receive_request();
+
+    bool receive_request(const char* data, size_t len);
+
+    bool make_input_room(size_t len);
+
+    bool next_request();
+
+    void parsed(uint64_t start);
+
+    void make_body_room();
+
+    int receive_body();
+
+    void skip_body();
 
-    void parse_request();
+    void finish_request();
 
-    inline void parse_request_line();
+    void log_access();
 
-    inline void parse_header();
+    void reset_request();
 
-    inline void parse_body();
+    bool wants_keep_alive();
 
-    inline void parse_params(const std::string& params_str, std::map<std::string, std::string>& params_map);
+    bool keep_alive() const;
 
-    inline void check_maps(std::map<std::string, std::string>& params_map);
+    bool request_ready() const;
 
-    inline int get_content_length();
+    bool closing() const;
+
+    long request_start() const;
+
+    Timer* timer();
+
+    int get_client_fd() const;
+
+    void parse_request_line();
+
+    void parse_header();
+
+    void parse_body();
+
+    void parse_params(Slice params_str, Param_list& params);
+
+    inline void check_params(const Param_list& params);
+
+    inline void check_headers();
+
+    inline long get_content_length();
 
     inline bool is_POST();
 
@@ -84,25 +219,89 @@ public:
 
     bool use_cgi();
 
-    inline void send_status200() const;
+    Output_queue::Result flush();
 
-    inline void send_error400() const;
+    bool output_full() const;
 
-    inline void send_error404() const;
+    void append_header_tail(bool content_type, long content_length);
 
-    void send_error500() const;
+    void set_status(int code);
 
-    inline void send_error501() const;
+    void send_head(Status_id status, long content_length);
 
-    // HANDLE HTTP REQUEST
-    std::string get_base_info();
+    void send_status200(long content_length = -1);
+
+    void send_error(Status_id status);
+
+    void send_error400();
+
+    void send_error413();
+
+    void send_error404();
 
-    void set_base_info(const std::string& buffer_str);
+    void send_error500();
 
+    void send_error501();
+
+    void send_error502();
+
+    void send_error503();
+
+    void send_error504();
+
+    void send_stats();
+
+    // HANDLE HTTP REQUEST
     void serve_file();
 
+    void send_cached(const std::shared_ptr<const File_cache::Entry>& entry);
+
     void execute_cgi();
 
+    bool fcgi_waiting() const;
+
+    const std::string& get_path() const;
+
+    void start_fcgi(Fcgi_worker* worker);
+
+    Timer* fcgi_timer();
+
+    bool cgi_running() const;
+
+    int get_cgi_epoll() const;
+
+    void start_cgi_io(int out_fd, int in_fd);
+
+    bool feed_cgi();
+
+    ssize_t write_cgi_stdin(const char* data, size_t len);
+
+    int flush_fcgi_out();
+
+    void end_cgi_stdin();
+
+    void abort_cgi(int status);
+
+    void watch(int fd, uint32_t& current, uint32_t events);
+
+    bool watch_cgi(bool output_blocked);
+
+    Cgi_state relay_cgi();
+
+    Cgi_state relay_pipe();
+
+    Cgi_state relay_fcgi();
+
+    void cgi_output(const char* data, size_t len);
+
+    void end_cgi_output();
+
+    void send_cgi_head(bool more);
+
+    void send_cgi_body(const char* data, size_t len);
+
+    void finish_cgi(bool kill_child = false);
+
 };
 
 #endif //MYHTTPD_Httpd_handler_H
@@ -0,0 +1,110 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <mutex>
+#include <thread>
+#include <cstdint>
+#include <cstddef>
+
+#ifndef MYHTTPD_IO_URING_H
+#define MYHTTPD_IO_URING_H
+
+// submission queue entries, the completion queue is 4 times as big, multishot requests post many completions
+#define URING_ENTRIES 1024
+// receive buffers provided to the kernel, a recv picks one when data arrives
+#define URING_BUF_NUMS 512
+#define URING_BUF_SIZE 4096
+#define URING_BUF_GROUP 0
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+// A completion copied out of the ring
+struct Uring_event {
+    uint64_t user_data;
+    int32_t res;
+    uint32_t flags;
+
+    // the request stays armed and will complete again
+    bool more() const;
+
+    // res bytes were received into buffer(buffer_id())
+    bool has_buffer() const;
+
+    uint16_t buffer_id() const;
+};
+
+// io_uring set up with raw syscalls, no liburing
+// Any thread may queue requests, they are put in the submission queue under sq_mutex_, the loop thread's wait()
+// submits and waits in the same call, so a request queued by it costs no syscall of its own, one queued by
+// another thread is submitted right away
+// The completion queue and the provided buffers are only touched by the loop thread
+// Built without HTTPD_IO_URING, set_up() always fails and the server stays on epoll
+class Io_uring {
+private:
+    int ring_fd_;
+    // submission queue
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    io_uring_sqe* sqes_;
+    std::mutex sq_mutex_;
+    // the thread waiting for completions, whatever it queues goes out with its next wait()
+    std::thread::id owner_;
+    // completion queue
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqes_;
+    // mappings
+    void* ring_ptr_;
+    size_t ring_size_;
+    size_t sqes_size_;
+    // provided buffers
+    char* bufs_;
+
+    io_uring_sqe* get_sqe();
+
+    void put_sqe();
+
+    int enter(unsigned to_submit, unsigned min_complete, unsigned flags);
+
+public:
+    Io_uring();
+
+    Io_uring(const Io_uring&) = delete;
+
+    Io_uring& operator=(const Io_uring&) = delete;
+
+    ~Io_uring();
+
+    // false if the kernel lacks anything used here, multishot accept is the newest (Linux 5.19)
+    bool set_up();
+
+    // the calling thread is the one to wait() from now on
+    void bind_thread();
+
+    // keep accepting on listen_fd, every connection completes with its fd, non-blocking and close-on-exec
+    void accept_multishot(int listen_fd, uint64_t user_data);
+
+    // complete once fd has events, with multishot every time it gets them
+    void poll(int fd, uint32_t events, uint64_t user_data, bool multishot = false);
+
+    // receive once into a provided buffer, whatever is there already or the next data to arrive
+    void recv(int fd, uint64_t user_data);
+
+    // send what has been queued by now, for threads other than the one waiting
+    void submit();
+
+    // submit what has been queued, wait for at least one completion and copy out up to max of them
+    int wait(Uring_event* events, int max);
+
+    const char* buffer(uint16_t id) const { return bufs_ + (size_t) id * URING_BUF_SIZE; }
+
+    // give a buffer back to the kernel once its data has been copied out, it goes with the next submit
+    void recycle(uint16_t id);
+};
+
+#endif //MYHTTPD_IO_URING_H
@@ -0,0 +1,142 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <atomic>
+#include <string>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+
+#ifndef MYHTTPD_LOGGER_H
+#define MYHTTPD_LOGGER_H
+
+// bytes of the ring of every thread, a record that doesn't fit is dropped and counted, the thread never waits
+#define LOG_RING_SIZE (1 << 20)
+// longest record, longer ones are cut
+#define LOG_LINE_MAX 4096
+// the writer's buffer of every log file, filled from all rings and written in one call
+#define LOG_BATCH_SIZE (64 << 10)
+// how long the writer sleeps once every ring is empty
+#define LOG_FLUSH_MS 10
+// the access log is renamed to <path>.1 and started over at this size, 0 leaves rotation to SIGHUP
+#define LOG_ROTATE_DEFAULT_SIZE (64L << 20)
+
+enum Log_level {
+    LOG_ERROR = 0,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG
+};
+
+// where a record goes
+enum Log_sink {
+    SINK_ACCESS = 0,
+    SINK_ERROR,
+    SINK_NUMS
+};
+
+// Single producer, single consumer byte ring of length-prefixed records
+// the owner thread pushes, the writer thread pops, they meet only at two atomic positions
+class Log_ring {
+private:
+    struct Record {
+        uint32_t len;
+        uint32_t sink;
+    };
+
+    char* buf_;
+    // positions only grow, the offset in buf_ is taken modulo LOG_RING_SIZE
+    std::atomic<size_t> head_;
+    std::atomic<size_t> tail_;
+
+public:
+    Log_ring* next;
+
+    Log_ring();
+
+    Log_ring(const Log_ring&) = delete;
+
+    Log_ring& operator=(const Log_ring&) = delete;
+
+    // false if there is no room
+    bool push(Log_sink sink, const char* data, size_t len);
+
+    // hand every record waiting to out(sink, data, len), return how many there were
+    template<typename Out>
+    size_t pop_all(Out out);
+};
+
+// Process-wide log, written by a background thread
+// Every thread formats its records on its own and pushes them into its own Log_ring, so logging takes no lock
+// and no syscall on the thread that logs, the writer gathers the records of all rings into one buffer per file
+// and writes each buffer out in one call
+// The access log is in the Combined Log Format, everything else goes to the error log with a level, the level
+// can be changed while running: SIGUSR1 logs more, SIGUSR2 less, SIGHUP reopens the files after an outside rotation
+class Logger {
+private:
+    std::atomic<int> level_;
+    std::atomic<bool> reopen_;
+    std::atomic<uint64_t> dropped_;
+    std::atomic<Log_ring*> rings_;
+    // file paths, empty for stdout and stderr, and "off" for no access log
+    std::string paths_[SINK_NUMS];
+    bool access_on_;
+    int fds_[SINK_NUMS];
+    size_t sizes_[SINK_NUMS];
+    long rotate_size_;
+
+    Logger();
+
+    Log_ring& ring();
+
+    void open_sink(int sink);
+
+    void write_sink(int sink, const char* data, size_t len);
+
+    void write_loop();
+
+    static void on_signal(int signal);
+
+public:
+    Logger(const Logger&) = delete;
+
+    Logger& operator=(const Logger&) = delete;
+
+    static Logger& instance();
+
+    // set up before start(), "-" for the standard stream, "off" to drop access records
+    void set_access_path(const char* path);
+
+    void set_error_path(const char* path);
+
+    void set_rotate_size(long size);
+
+    void set_level(int level);
+
+    // open the files, install the signal handlers and start the writer thread
+    void start();
+
+    bool enabled(Log_level level) const { return level <= level_.load(std::memory_order_relaxed); }
+
+    bool access_enabled() const { return access_on_; }
+
+    // push a formatted record, the line end is added
+    void log(Log_level level, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+
+    // push an access log line as it is
+    void access(const char* line, size_t len);
+
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+};
+
+// nothing is formatted unless the level is on
+#define LOG(level, ...) do { \
+    if (Logger::instance().enabled(level)) \
+        Logger::instance().log(level, __VA_ARGS__); \
+} while (0)
+
+// "[17/Oct/2026:08:12:31 +0000]" of the current second, cached per thread like date_header()
+const char* log_time();
+
+#endif //MYHTTPD_LOGGER_H
@@ -0,0 +1,106 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <ctime>
+#include <atomic>
+#include <string>
+#include <cstdint>
+#include "http_response.h"
+
+#ifndef MYHTTPD_METRICS_H
+#define MYHTTPD_METRICS_H
+
+// sub-buckets per power of two of a histogram, the error of a value read back is below 1 / 2^METRICS_SUB_BITS
+#define METRICS_SUB_BITS 4
+// values are nanoseconds, the last bucket holds everything from about 2^40 ns, 18 minutes, up
+#define METRICS_BUCKETS ((41 - METRICS_SUB_BITS) << METRICS_SUB_BITS)
+#define STATS_PATH "/__stats"
+
+enum Counter_id {
+    COUNTER_ACCEPTED = 0,
+    COUNTER_CLOSED,
+    COUNTER_BYTES_SENT,
+    COUNTER_CGI_SPAWNED,
+    COUNTER_NUMS
+};
+
+enum Histogram_id {
+    HISTOGRAM_PARSE = 0,
+    HISTOGRAM_FIRST_BYTE,
+    HISTOGRAM_CGI_SPAWN,
+    HISTOGRAM_NUMS
+};
+
+// Log-linear histogram of nanoseconds, like HdrHistogram: every power of two is split in 2^METRICS_SUB_BITS buckets
+// Only the thread owning it records, any thread may read it while it does
+class Metrics_histogram {
+private:
+    std::atomic<uint64_t> buckets_[METRICS_BUCKETS];
+    std::atomic<uint64_t> count_;
+    std::atomic<uint64_t> sum_;
+
+public:
+    Metrics_histogram();
+
+    static int bucket(uint64_t value);
+
+    // the middle of the values in the bucket
+    static uint64_t value(int index);
+
+    void record(uint64_t ns);
+
+    // add this histogram's buckets to counts, and its count and sum
+    void read(uint64_t* counts, uint64_t& count, uint64_t& sum) const;
+};
+
+// Everything one thread has counted
+// its counters are written by that thread alone, with plain loads and stores on atomics: no lock, no locked
+// instruction, and a reader on another thread still never sees a torn value
+struct Metrics_shard {
+    std::atomic<uint64_t> counters[COUNTER_NUMS];
+    // responses by status, the last one counts statuses not in http_statuses
+    std::atomic<uint64_t> responses[STATUS_ID_NUMS + 1];
+    Metrics_histogram histograms[HISTOGRAM_NUMS];
+    Metrics_shard* next;
+
+    Metrics_shard();
+};
+
+// Process-wide metrics, kept per thread and summed up when read
+// A thread gets its shard the first time it counts something, shards are pushed onto a lock-free list and never freed,
+// so the totals of a thread that has exited stay in them
+class Metrics {
+private:
+    static std::atomic<Metrics_shard*> shards_;
+
+    static Metrics_shard* add_shard();
+
+    static void add(std::atomic<uint64_t>& value, uint64_t n) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+public:
+    static Metrics_shard& local() {
+        static thread_local Metrics_shard* shard = add_shard();
+        return *shard;
+    }
+
+    static uint64_t now_ns() {
+        struct timespec now{};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+    }
+
+    static void count(Counter_id id, uint64_t n = 1) { add(local().counters[id], n); }
+
+    // status is a Status_id, or STATUS_ID_NUMS for any other status
+    static void count_response(int status) { add(local().responses[status], 1); }
+
+    static void record(Histogram_id id, uint64_t ns) { local().histograms[id].record(ns); }
+
+    // all shards summed up, in the Prometheus text format
+    static std::string prometheus();
+};
+
+#endif //MYHTTPD_METRICS_H
@@ -0,0 +1,106 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <fcntl.h>
+
+#ifndef MYHTTPD_OUTPUT_QUEUE_H
+#define MYHTTPD_OUTPUT_QUEUE_H
+
+// no more responses are queued once this many bytes wait for the client
+#define OUTPUT_HIGH_WATER (256 << 10)
+// buffers gathered into one sendmsg
+#define OUTPUT_MAX_IOV 64
+// largest buffer of a sent chunk kept for the next one, bigger ones are freed so idle connections stay small
+#define OUTPUT_SPARE_SIZE (4 << 10)
+
+// Response bytes of one connection waiting to be written to a non-blocking socket
+// Memory is either copied in, shared with its owner like a cached file, or static like a canned response, files are sent with sendfile
+// and bytes waiting in a pipe are spliced to the socket without passing through user space
+// flush() writes as much as the socket takes and remembers where it stopped
+class Output_queue {
+public:
+    enum Result {
+        DONE,
+        AGAIN,
+        ERROR
+    };
+
+private:
+    struct Chunk {
+        // copied bytes, small pieces appended one after another end up in the same chunk
+        std::string bytes;
+        // bytes owned by someone else, kept alive until they are sent
+        std::shared_ptr<const std::string> shared;
+        // bytes that never go away, like the canned responses
+        const char* fixed = nullptr;
+        // a file range, the queue closes file_fd when it is sent or dropped
+        // or with pipe set, bytes of a pipe owned by someone else
+        int file_fd = -1;
+        off_t offset = 0;
+        bool pipe = false;
+        // bytes of the chunk already sent, and still to send
+        size_t sent = 0;
+        size_t left = 0;
+
+        const char* data() const { return (fixed ? fixed : shared ? shared->data() : bytes.data()) + sent; }
+
+        bool copied() const { return file_fd == -1 && !shared && fixed == nullptr; }
+    };
+
+    std::deque<Chunk> chunks_;
+    size_t pending_ = 0;
+    // every byte ever appended, responses are measured by the difference
+    uint64_t appended_ = 0;
+    // the buffer of the last copied chunk sent, reused by the next one, so steady traffic doesn't allocate
+    std::string spare_;
+
+    void recycle(Chunk& chunk);
+
+    void consume(size_t num_sent);
+
+public:
+    Output_queue() = default;
+
+    Output_queue(const Output_queue&) = delete;
+
+    Output_queue& operator=(const Output_queue&) = delete;
+
+    ~Output_queue();
+
+    void append(const char* data, size_t len);
+
+    void append(const std::shared_ptr<const std::string>& data);
+
+    // data must stay valid for the life of the process, it is sent from where it is
+    void append_static(const char* data, size_t len);
+
+    // the queue takes file_fd over and closes it
+    void append_file(int file_fd, off_t offset, size_t len);
+
+    // len bytes already in pipe_fd, the caller keeps the pipe and reads nothing more from it until they are sent
+    void append_pipe(int pipe_fd, size_t len);
+
+    bool empty() const { return chunks_.empty(); }
+
+    bool full() const { return pending_ >= OUTPUT_HIGH_WATER; }
+
+    size_t pending() const { return pending_; }
+
+    uint64_t appended() const { return appended_; }
+
+    // DONE if everything is sent, AGAIN if the socket is full, ERROR if the client has gone away
+    Result flush(int socket);
+
+    void clear();
+};
+
+#endif //MYHTTPD_OUTPUT_QUEUE_H
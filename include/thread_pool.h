@@ -0,0 +1,42 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <queue>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+#ifndef MYHTTPD_THREAD_POOL_H
+#define MYHTTPD_THREAD_POOL_H
+
+// A fixed-size pool of worker threads sharing one FIFO task queue
+// Workers are created once in the constructor and joined in the destructor
+class Thread_pool {
+private:
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stop_;
+
+    void work();
+
+public:
+    // thread_nums <= 0 means one worker per core
+    explicit Thread_pool(int thread_nums = 0);
+
+    Thread_pool(const Thread_pool&) = delete;
+
+    Thread_pool& operator=(const Thread_pool&) = delete;
+
+    ~Thread_pool();
+
+    void submit(std::function<void()> task);
+
+    int size() const;
+};
+
+#endif //MYHTTPD_THREAD_POOL_H
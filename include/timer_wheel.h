@@ -0,0 +1,60 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <vector>
+#include <ctime>
+#include <cstddef>
+
+#ifndef MYHTTPD_TIMER_WHEEL_H
+#define MYHTTPD_TIMER_WHEEL_H
+
+// one slot per second, timeouts shorter than this never wrap around the wheel
+#define TIMER_WHEEL_SLOTS 64
+
+// A timer is embedded in whatever it times, so arming and cancelling never allocate
+struct Timer {
+    Timer* prev = nullptr;
+    Timer* next = nullptr;
+    long expire = 0;
+    int fd = -1;
+
+    bool armed() const { return prev != nullptr; }
+};
+
+// Hashed timer wheel with one second ticks
+// add, remove and reaping an expired timer are O(1), a tick only looks at the timers of its own slot
+// Timers further away than TIMER_WHEEL_SLOTS seconds stay in their slot until their round comes
+// Not thread safe, the owner guards it
+class Timer_wheel {
+private:
+    // sentinels of the circular lists, one per slot
+    Timer slots_[TIMER_WHEEL_SLOTS];
+    // the last second advance() has processed
+    long current_;
+    size_t size_;
+
+    static void unlink(Timer* timer);
+
+public:
+    Timer_wheel();
+
+    Timer_wheel(const Timer_wheel&) = delete;
+
+    Timer_wheel& operator=(const Timer_wheel&) = delete;
+
+    // arm timer to expire at the given second, re-arming it if it is armed already
+    void add(Timer* timer, long expire);
+
+    void remove(Timer* timer);
+
+    bool empty() const { return size_ == 0; }
+
+    // process every second up to now, expired timers are removed and their fd appended to expired
+    void advance(long now, std::vector<int>& expired);
+
+    // seconds of CLOCK_MONOTONIC, not affected by changing the system time
+    static long now();
+};
+
+#endif //MYHTTPD_TIMER_WHEEL_H
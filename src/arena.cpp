@@ -0,0 +1,74 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include "arena.h"
+
+Arena::Arena() : first_(nullptr), current_(nullptr), used_(0) {}
+
+Arena::~Arena() {
+    reset();
+    free(first_);
+}
+
+// blocks are at least ARENA_BLOCK_SIZE, bigger only for a single big allocation
+Arena::Block* Arena::new_block(size_t size) {
+    if (size < ARENA_BLOCK_SIZE)
+        size = ARENA_BLOCK_SIZE;
+    Block* block = (Block*) malloc(sizeof(Block) + size);
+    if (block == nullptr)
+        throw std::bad_alloc();
+    block->next = nullptr;
+    block->size = size;
+    return block;
+}
+
+void* Arena::allocate(size_t size, size_t align) {
+    if (current_ != nullptr){
+        size_t start = (used_ + align - 1) & ~(align - 1);
+        if (start + size <= current_->size){
+            used_ = start + size;
+            return data(current_) + start;
+        }
+    }
+    // block data starts max_align_t aligned, so a fresh block needs no padding
+    Block* block = new_block(size);
+    if (first_ == nullptr)
+        first_ = block;
+    else
+        current_->next = block;
+    current_ = block;
+    used_ = size;
+    return data(block);
+}
+
+char* Arena::format(const char* fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int len = vsnprintf(nullptr, 0, fmt, args_copy);
+    va_end(args_copy);
+    char* s = (char*) allocate(len + 1, 1);
+    vsnprintf(s, len + 1, fmt, args);
+    va_end(args);
+    return s;
+}
+
+// free every block but the first one, and start over at the beginning of it
+void Arena::reset() {
+    if (first_ == nullptr)
+        return;
+    Block* block = first_->next;
+    while (block != nullptr){
+        Block* next = block->next;
+        free(block);
+        block = next;
+    }
+    first_->next = nullptr;
+    current_ = first_;
+    used_ = 0;
+}
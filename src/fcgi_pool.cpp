@@ -0,0 +1,202 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <fcntl.h>
+#include <wait.h>
+#include <sys/un.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include "fcgi_pool.h"
+#include "metrics.h"
+#include "logger.h"
+
+Fcgi_pool::Fcgi_pool() : max_workers_(FCGI_DEFAULT_WORKERS), spawned_(0) {}
+
+// never destroyed, like the workers it started, which go away with the server
+Fcgi_pool& Fcgi_pool::instance() {
+    static Fcgi_pool* pool = new Fcgi_pool();
+    return *pool;
+}
+
+void Fcgi_pool::set_max_workers(size_t max_workers) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_workers_ = max_workers;
+}
+
+bool Fcgi_pool::enabled() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return max_workers_ > 0;
+}
+
+// start one worker of path, listening on an abstract Unix socket nobody else knows the name of
+// return nullptr if it couldn't be started
+Fcgi_worker* Fcgi_pool::spawn(const std::string& path) {
+    struct sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    unsigned long id;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        id = spawned_++;
+    }
+    // sun_path starting with a NUL byte is in the abstract namespace, there is no file to clean up
+    int name_len = snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "myhttpd-fcgi-%d-%lu", getpid(), id);
+    socklen_t addr_len = offsetof(struct sockaddr_un, sun_path) + 1 + name_len;
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1)
+        return nullptr;
+    if (bind(listen_fd, (struct sockaddr*) &addr, addr_len) == -1 || listen(listen_fd, 1) == -1){
+        perror("ERROR: fcgi worker socket failed\n");
+        close(listen_fd);
+        return nullptr;
+    }
+    uint64_t spawn_start = Metrics::now_ns();
+    pid_t pid = fork();
+    if (pid < 0){
+        close(listen_fd);
+        return nullptr;
+    }
+    // child, FCGI_LISTENSOCK_FILENO is 0, dup2 clears close-on-exec on the copy
+    if (pid == 0){
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        dup2(listen_fd, 0);
+        execl(path.c_str(), path.c_str(), (char*) nullptr);
+        _exit(1);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 || connect(fd, (struct sockaddr*) &addr, addr_len) == -1){
+        perror("ERROR: connect fcgi worker failed\n");
+        if (fd != -1)
+            close(fd);
+        close(listen_fd);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        return nullptr;
+    }
+    // the backlog holds our connection until the child accepts it
+    close(listen_fd);
+    Metrics::record(HISTOGRAM_CGI_SPAWN, Metrics::now_ns() - spawn_start);
+    Metrics::count(COUNTER_CGI_SPAWNED);
+    Fcgi_worker* worker = new Fcgi_worker();
+    worker->path = path;
+    worker->pid = pid;
+    worker->fd = fd;
+    worker->timer.fd = fd;
+    LOG(LOG_INFO, "started fcgi worker %d for %s", pid, path.c_str());
+    return worker;
+}
+
+void Fcgi_pool::discard(Fcgi_worker* worker) {
+    close(worker->fd);
+    kill(worker->pid, SIGKILL);
+    waitpid(worker->pid, nullptr, 0);
+    delete worker;
+}
+
+bool Fcgi_pool::acquire(const std::string& path, Fcgi_worker*& worker, const Waiter& waiter) {
+    worker = nullptr;
+    std::vector<Fcgi_worker*> dead;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Script& script = scripts_[path];
+        while (!script.idle.empty()){
+            Fcgi_worker* idle = script.idle.back();
+            script.idle.pop_back();
+            // an idle worker has nothing to say, readable means it has exited
+            char byte;
+            if (recv(idle->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == -1 && errno == EAGAIN){
+                worker = idle;
+                break;
+            }
+            dead.push_back(idle);
+            script.worker_nums--;
+        }
+        if (worker == nullptr){
+            if (script.worker_nums >= max_workers_){
+                if (script.waiting.size() >= FCGI_QUEUE_SIZE)
+                    return true;
+                script.waiting.push_back(waiter);
+                return false;
+            }
+            script.worker_nums++;
+        }
+    }
+    for (Fcgi_worker* dead_worker : dead)
+        discard(dead_worker);
+    if (worker != nullptr)
+        return true;
+    worker = spawn(path);
+    if (worker == nullptr){
+        std::lock_guard<std::mutex> lock(mutex_);
+        scripts_[path].worker_nums--;
+    }
+    return true;
+}
+
+// the next waiting request gets the worker, or a fresh one if it can't be reused
+void Fcgi_pool::release(Fcgi_worker* worker, bool reusable) {
+    std::string path = worker->path;
+    Waiter waiter;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Script& script = scripts_[path];
+        if (!script.waiting.empty()){
+            waiter = std::move(script.waiting.front());
+            script.waiting.pop_front();
+        }
+        else if (reusable){
+            script.idle.push_back(worker);
+            return;
+        }
+        // the replacement started below takes the discarded worker's place
+        if (!reusable && !waiter)
+            script.worker_nums--;
+    }
+    if (!reusable){
+        discard(worker);
+        worker = waiter ? spawn(path) : nullptr;
+        if (waiter && worker == nullptr){
+            std::lock_guard<std::mutex> lock(mutex_);
+            scripts_[path].worker_nums--;
+        }
+    }
+    if (waiter)
+        waiter(worker);
+}
+
+void fcgi_record(std::string& out, int type, const char* content, size_t len) {
+    do {
+        size_t part = len > 0xffff ? 0xffff : len;
+        unsigned char header[FCGI_HEADER_LEN] = {
+                FCGI_VERSION_1, (unsigned char) type, 0, FCGI_REQUEST_ID,
+                (unsigned char) (part >> 8), (unsigned char) part, 0, 0};
+        out.append((const char*) header, FCGI_HEADER_LEN);
+        out.append(content, part);
+        content += part;
+        len -= part;
+    } while (len > 0);
+}
+
+// lengths below 128 take one byte, longer ones four with the high bit set
+static void fcgi_length(std::string& out, size_t len) {
+    if (len < 128){
+        out.push_back((char) len);
+        return;
+    }
+    out.push_back((char) ((len >> 24) | 0x80));
+    out.push_back((char) (len >> 16));
+    out.push_back((char) (len >> 8));
+    out.push_back((char) len);
+}
+
+void fcgi_param(std::string& out, const char* name, const char* value, size_t value_len) {
+    size_t name_len = strlen(name);
+    fcgi_length(out, name_len);
+    fcgi_length(out, value_len);
+    out.append(name, name_len);
+    out.append(value, value_len);
+}
@@ -0,0 +1,162 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <thread>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "file_cache.h"
+
+#define INOTIFY_MASK (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                      IN_DELETE_SELF | IN_MOVE_SELF)
+
+File_cache::File_cache() : capacity_(FILE_CACHE_DEFAULT_SIZE), used_(0), generation_(1), inotify_fd_(-1) {
+    inotify_fd_ = inotify_init1(IN_CLOEXEC);
+    if (inotify_fd_ == -1){
+        perror("ERROR: inotify init failed, static file cache disabled\n");
+        capacity_ = 0;
+        return;
+    }
+    std::thread(&File_cache::watch_loop, this).detach();
+}
+
+// never destroyed, the inotify thread keeps using it until the process exits
+File_cache& File_cache::instance() {
+    static File_cache* cache = new File_cache();
+    return *cache;
+}
+
+void File_cache::set_capacity(size_t capacity) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (inotify_fd_ == -1)
+        return;
+    capacity_ = capacity;
+    evict(0);
+}
+
+// only small files are worth keeping in memory, big ones are better served by sendfile
+bool File_cache::cacheable(size_t file_size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return file_size <= FILE_CACHE_MAX_ENTRY && file_size <= capacity_ / 2;
+}
+
+// return nullptr on miss, the entry stays valid for the caller even if it is evicted meanwhile
+std::shared_ptr<const File_cache::Entry> File_cache::get(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<std::string, Node>::iterator it = entries_.find(path);
+    if (it == entries_.end())
+        return nullptr;
+    lru_.splice(lru_.begin(), lru_, it->second.lru_pos);
+    return it->second.entry;
+}
+
+// start watching the directory of path, call it before reading the file
+// return the generation to pass to put(), 0 if the file can't be cached
+uint64_t File_cache::watch(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (capacity_ == 0)
+        return 0;
+    std::string dir = path.substr(0, path.rfind('/'));
+    if (!watch_dir(dir))
+        return 0;
+    return generation_;
+}
+
+// insert the entry unless some file changed since watch() returned generation
+void File_cache::put(const std::string& path, const std::shared_ptr<const Entry>& entry, uint64_t generation) {
+    size_t size = entry->header.size() + entry->body.size();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (generation != generation_ || size > capacity_)
+        return;
+    erase(path);
+    evict(size);
+    lru_.push_front(path);
+    Node node;
+    node.entry = entry;
+    node.lru_pos = lru_.begin();
+    entries_[path] = node;
+    used_ += size;
+}
+
+// drop least recently used entries until needed more bytes fit in the budget
+void File_cache::evict(size_t needed) {
+    while (!lru_.empty() && used_ + needed > capacity_)
+        erase(lru_.back());
+}
+
+void File_cache::erase(const std::string& path) {
+    std::unordered_map<std::string, Node>::iterator it = entries_.find(path);
+    if (it == entries_.end())
+        return;
+    used_ -= it->second.entry->header.size() + it->second.entry->body.size();
+    lru_.erase(it->second.lru_pos);
+    entries_.erase(it);
+}
+
+// drop every entry below dir, used when the directory itself goes away
+void File_cache::erase_dir(const std::string& dir) {
+    std::string prefix = dir + "/";
+    for (std::unordered_map<std::string, Node>::iterator it = entries_.begin(); it != entries_.end();){
+        if (it->first.compare(0, prefix.size(), prefix) == 0){
+            used_ -= it->second.entry->header.size() + it->second.entry->body.size();
+            lru_.erase(it->second.lru_pos);
+            it = entries_.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+bool File_cache::watch_dir(const std::string& dir) {
+    if (dir_watches_.count(dir))
+        return true;
+    int wd = inotify_add_watch(inotify_fd_, dir.c_str(), INOTIFY_MASK);
+    if (wd == -1)
+        return false;
+    dir_watches_[dir] = wd;
+    watch_dirs_[wd].push_back(dir);
+    return true;
+}
+
+// background thread, translate inotify events into invalidations
+void File_cache::watch_loop() {
+    // large enough for several events with maximal names
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    while (true){
+        ssize_t num_read = read(inotify_fd_, buffer, sizeof(buffer));
+        if (num_read <= 0){
+            if (num_read == -1 && errno == EINTR)
+                continue;
+            perror("ERROR: inotify read failed, static file cache disabled\n");
+            set_capacity(0);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        generation_++;
+        for (char* p = buffer; p < buffer + num_read;){
+            struct inotify_event* event = (struct inotify_event*) p;
+            p += sizeof(struct inotify_event) + event->len;
+            // events were lost, nothing in the cache can be trusted
+            if (event->mask & IN_Q_OVERFLOW){
+                evict(capacity_ + 1);
+                continue;
+            }
+            std::map<int, std::vector<std::string>>::iterator it = watch_dirs_.find(event->wd);
+            if (it == watch_dirs_.end())
+                continue;
+            for (auto& dir : it->second){
+                if (event->len > 0)
+                    erase(dir + "/" + event->name);
+                else
+                    erase_dir(dir);
+            }
+            // the watch was removed by the kernel, the directory will be watched again on the next fill
+            if (event->mask & IN_IGNORED){
+                for (auto& dir : it->second)
+                    dir_watches_.erase(dir);
+                watch_dirs_.erase(it);
+            }
+        }
+    }
+}
@@ -0,0 +1,391 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include "http_parser.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+// SSE2 is part of x86-64, 16 bytes per step
+static const char* find_char_sse2(const char* p, const char* end, char c) {
+    __m128i target = _mm_set1_epi8(c);
+    while (end - p >= 16){
+        __m128i chunk = _mm_loadu_si128((const __m128i*) p);
+        unsigned mask = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, target));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    while (p < end && *p != c)
+        p++;
+    return p;
+}
+
+// 32 bytes per step, only called when the CPU has AVX2
+__attribute__((target("avx2")))
+static const char* find_char_avx2(const char* p, const char* end, char c) {
+    __m256i target = _mm256_set1_epi8(c);
+    while (end - p >= 32){
+        __m256i chunk = _mm256_loadu_si256((const __m256i*) p);
+        unsigned mask = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, target));
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    return find_char_sse2(p, end, c);
+}
+
+static bool cpu_has_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static const bool use_avx2 = cpu_has_avx2();
+
+const char* find_char(const char* p, const char* end, char c) {
+    if (use_avx2)
+        return find_char_avx2(p, end, c);
+    return find_char_sse2(p, end, c);
+}
+#else
+const char* find_char(const char* p, const char* end, char c) {
+    const void* found = memchr(p, c, end - p);
+    return found == nullptr ? end : (const char*) found;
+}
+#endif
+
+// Well-known names have distinct (length, first letter) pairs, which works as a perfect hash
+// one strncasecmp confirms the only candidate
+Header_id header_id(const char* name, size_t len) {
+    if (len == 0)
+        return HEADER_UNKNOWN;
+    const char* candidate = nullptr;
+    Header_id id = HEADER_UNKNOWN;
+    char first = (char) (name[0] | 0x20);
+    switch (len){
+        case 4:
+            if (first == 'h') { candidate = "Host"; id = HEADER_HOST; }
+            break;
+        case 5:
+            if (first == 'r') { candidate = "Range"; id = HEADER_RANGE; }
+            break;
+        case 6:
+            if (first == 'a') { candidate = "Accept"; id = HEADER_ACCEPT; }
+            else if (first == 'c') { candidate = "Cookie"; id = HEADER_COOKIE; }
+            else if (first == 'e') { candidate = "Expect"; id = HEADER_EXPECT; }
+            break;
+        case 7:
+            if (first == 'r') { candidate = "Referer"; id = HEADER_REFERER; }
+            else if (first == 'u') { candidate = "Upgrade"; id = HEADER_UPGRADE; }
+            break;
+        case 8:
+            if (first == 'i') { candidate = "If-Range"; id = HEADER_IF_RANGE; }
+            break;
+        case 10:
+            if (first == 'c') { candidate = "Connection"; id = HEADER_CONNECTION; }
+            else if (first == 'u') { candidate = "User-Agent"; id = HEADER_USER_AGENT; }
+            break;
+        case 12:
+            if (first == 'c') { candidate = "Content-Type"; id = HEADER_CONTENT_TYPE; }
+            break;
+        case 13:
+            if (first == 'i') { candidate = "If-None-Match"; id = HEADER_IF_NONE_MATCH; }
+            break;
+        case 14:
+            if (first == 'c') { candidate = "Content-Length"; id = HEADER_CONTENT_LENGTH; }
+            else if (first == 'h') { candidate = "HTTP2-Settings"; id = HEADER_HTTP2_SETTINGS; }
+            break;
+        case 15:
+            if (first == 'a') { candidate = "Accept-Encoding"; id = HEADER_ACCEPT_ENCODING; }
+            break;
+        case 17:
+            if (first == 'i') { candidate = "If-Modified-Since"; id = HEADER_IF_MODIFIED_SINCE; }
+            else if (first == 't') { candidate = "Transfer-Encoding"; id = HEADER_TRANSFER_ENCODING; }
+            break;
+        default:
+            break;
+    }
+    if (candidate != nullptr && strncasecmp(name, candidate, len) == 0)
+        return id;
+    return HEADER_UNKNOWN;
+}
+
+bool Slice::has_token(const char* token) const {
+    size_t token_len = strlen(token);
+    const char* p = data;
+    const char* end = data + len;
+    while (p < end){
+        const char* comma = find_char(p, end, ',');
+        const char* item_end = comma;
+        while (p < item_end && (*p == ' ' || *p == '\t'))
+            p++;
+        while (item_end > p && (item_end[-1] == ' ' || item_end[-1] == '\t'))
+            item_end--;
+        if ((size_t) (item_end - p) == token_len && strncasecmp(p, token, token_len) == 0)
+            return true;
+        p = comma + 1;
+    }
+    return false;
+}
+
+void Param_list::add(Slice name, Slice value) {
+    if (nums_ == MAX_PARAM_NUMS)
+        return;
+    names_[nums_] = name;
+    values_[nums_] = value;
+    nums_++;
+}
+
+Slice Param_list::find(const char* name) const {
+    for (int i = 0; i < nums_; i++){
+        if (names_[i].equals(name))
+            return values_[i];
+    }
+    return Slice{nullptr, 0};
+}
+
+Http_parser::Http_parser(size_t max_head_size) : max_head_size_(max_head_size) {
+    reset();
+}
+
+void Http_parser::reset() {
+    state_ = NEED_MORE;
+    line_start_ = 0;
+    scanned_ = 0;
+    head_size_ = 0;
+    base_ = nullptr;
+    method_ = target_ = version_ = Span{0, 0};
+    header_nums_ = 0;
+    memset(header_index_, -1, sizeof(header_index_));
+    content_length_ = -1;
+}
+
+Slice Http_parser::header(Header_id id) const {
+    if (id == HEADER_UNKNOWN || header_index_[id] == -1)
+        return Slice{nullptr, 0};
+    return slice(headers_[header_index_[id]].value);
+}
+
+Slice Http_parser::header(const char* name) const {
+    Header_id id = header_id(name, strlen(name));
+    if (id != HEADER_UNKNOWN)
+        return header(id);
+    for (int i = 0; i < header_nums_; i++){
+        if (slice(headers_[i].name).equals_nocase(name))
+            return slice(headers_[i].value);
+    }
+    return Slice{nullptr, 0};
+}
+
+// take every complete line in buf, the unfinished last line is scanned but left for the next call
+Http_parser::State Http_parser::parse(const char* buf, size_t len) {
+    base_ = buf;
+    if (state_ != NEED_MORE)
+        return state_;
+    while (true){
+        const char* lf = find_char(buf + scanned_, buf + len, '\n');
+        if (lf == buf + len){
+            scanned_ = len;
+            if (len > max_head_size_)
+                state_ = ERROR;
+            return state_;
+        }
+        scanned_ = lf - buf + 1;
+        if (scanned_ > max_head_size_)
+            return state_ = ERROR;
+
+        // the line is [start, end), without its CRLF or bare LF
+        size_t start = line_start_;
+        size_t end = lf - buf;
+        if (end > start && buf[end - 1] == '\r')
+            end--;
+        line_start_ = scanned_;
+
+        if (end == start){
+            // empty lines before the request line are ignored, after it they end the head
+            if (method_.len == 0)
+                continue;
+            head_size_ = scanned_;
+            return state_ = DONE;
+        }
+        bool ok = method_.len == 0 ? parse_request_line(start, end) : parse_header_line(start, end);
+        if (!ok)
+            return state_ = ERROR;
+    }
+}
+
+// method SP request-target SP HTTP-version
+bool Http_parser::parse_request_line(size_t start, size_t end) {
+    const char* line_end = base_ + end;
+    const char* sp1 = find_char(base_ + start, line_end, ' ');
+    if (sp1 == line_end)
+        return false;
+    const char* sp2 = find_char(sp1 + 1, line_end, ' ');
+    if (sp2 == line_end)
+        return false;
+    method_ = Span{(uint32_t) start, (uint32_t) (sp1 - base_ - start)};
+    target_ = Span{(uint32_t) (sp1 + 1 - base_), (uint32_t) (sp2 - sp1 - 1)};
+    version_ = Span{(uint32_t) (sp2 + 1 - base_), (uint32_t) (line_end - sp2 - 1)};
+    return method_.len > 0 && target_.len > 0 &&
+           version_.len > 5 && memcmp(base_ + version_.off, "HTTP/", 5) == 0;
+}
+
+// field-name ":" OWS field-value OWS
+bool Http_parser::parse_header_line(size_t start, size_t end) {
+    // obsolete line folding is not supported
+    if (base_[start] == ' ' || base_[start] == '\t')
+        return false;
+    if (header_nums_ == MAX_HEADER_NUMS)
+        return false;
+    const char* line_end = base_ + end;
+    const char* colon = find_char(base_ + start, line_end, ':');
+    if (colon == line_end || colon == base_ + start)
+        return false;
+    // whitespace before the colon is not allowed
+    if (colon[-1] == ' ' || colon[-1] == '\t')
+        return false;
+    const char* value = colon + 1;
+    const char* value_end = line_end;
+    while (value < value_end && (*value == ' ' || *value == '\t'))
+        value++;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t'))
+        value_end--;
+
+    Header& header = headers_[header_nums_];
+    header.name = Span{(uint32_t) start, (uint32_t) (colon - base_ - start)};
+    header.value = Span{(uint32_t) (value - base_), (uint32_t) (value_end - value)};
+    header.id = header_id(base_ + start, header.name.len);
+    if (header.id != HEADER_UNKNOWN && header_index_[header.id] == -1)
+        header_index_[header.id] = (int8_t) header_nums_;
+    header_nums_++;
+
+    // the length decides where the request ends, so it is checked strictly here
+    if (header.id == HEADER_CONTENT_LENGTH){
+        if (value == value_end)
+            return false;
+        long length = 0;
+        for (const char* p = value; p < value_end; p++){
+            if (*p < '0' || *p > '9' || length > (1L << 40))
+                return false;
+            length = length * 10 + (*p - '0');
+        }
+        if (content_length_ != -1 && content_length_ != length)
+            return false;
+        content_length_ = length;
+    }
+    return true;
+}
+
+void Body_reader::reset(long content_length, bool chunked) {
+    received_ = 0;
+    digits_ = 0;
+    left_ = 0;
+    if (chunked){
+        state_ = BODY;
+        step_ = CHUNK_SIZE;
+    }
+    else{
+        state_ = content_length > 0 ? BODY : DONE;
+        step_ = LENGTH;
+        left_ = content_length > 0 ? (uint64_t) content_length : 0;
+    }
+}
+
+// chunk-size [; extensions] CRLF, chunk-data CRLF, ..., 0 CRLF, trailer fields, CRLF
+// bare LF is taken for CRLF, the same as in the head
+size_t Body_reader::next(const char* p, size_t len, size_t& data_len) {
+    data_len = 0;
+    size_t i = 0;
+    while (state_ == BODY){
+        if (step_ == LENGTH || step_ == CHUNK_DATA){
+            data_len = (size_t) std::min<uint64_t>(left_, len - i);
+            return i;
+        }
+        if (i == len)
+            return i;
+        char c = p[i++];
+        switch (step_){
+            case CHUNK_SIZE:
+                if (isxdigit((unsigned char) c)){
+                    if (++digits_ > 10){
+                        state_ = ERROR;
+                        break;
+                    }
+                    left_ = left_ * 16 + (c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+                }
+                else if (digits_ > 0 && (c == ';' || c == ' ' || c == '\t'))
+                    step_ = CHUNK_EXT;
+                else if (digits_ > 0 && c == '\r')
+                    step_ = CHUNK_SIZE_LF;
+                else if (digits_ > 0 && c == '\n')
+                    step_ = left_ > 0 ? CHUNK_DATA : TRAILER;
+                else
+                    state_ = ERROR;
+                break;
+            case CHUNK_EXT:
+                if (c == '\n')
+                    step_ = left_ > 0 ? CHUNK_DATA : TRAILER;
+                else if (c == '\r')
+                    step_ = CHUNK_SIZE_LF;
+                break;
+            case CHUNK_SIZE_LF:
+                if (c == '\n')
+                    step_ = left_ > 0 ? CHUNK_DATA : TRAILER;
+                else
+                    state_ = ERROR;
+                break;
+            case CHUNK_DATA_CR:
+                if (c == '\r')
+                    step_ = CHUNK_DATA_LF;
+                else if (c == '\n'){
+                    step_ = CHUNK_SIZE;
+                    digits_ = 0;
+                }
+                else
+                    state_ = ERROR;
+                break;
+            case CHUNK_DATA_LF:
+                if (c == '\n'){
+                    step_ = CHUNK_SIZE;
+                    digits_ = 0;
+                }
+                else
+                    state_ = ERROR;
+                break;
+            // trailer fields are skipped, the empty line after them ends the body
+            case TRAILER:
+                if (c == '\n')
+                    state_ = DONE;
+                else
+                    step_ = c == '\r' ? TRAILER_LF : TRAILER_LINE;
+                break;
+            case TRAILER_LINE:
+                if (c == '\n')
+                    step_ = TRAILER;
+                break;
+            case TRAILER_LF:
+                if (c == '\n')
+                    state_ = DONE;
+                else
+                    step_ = TRAILER_LINE;
+                break;
+            default:
+                break;
+        }
+    }
+    return i;
+}
+
+void Body_reader::consume(size_t n) {
+    if (n == 0)
+        return;
+    left_ -= n;
+    received_ += n;
+    if (left_ == 0){
+        if (step_ == LENGTH)
+            state_ = DONE;
+        else
+            step_ = CHUNK_DATA_CR;
+    }
+}
@@ -0,0 +1,33 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include "http_response.h"
+
+Slice date_header() {
+    static thread_local time_t second = 0;
+    static thread_local char text[64];
+    static thread_local size_t len = 0;
+    // the coarse clock is read from the vDSO without a syscall, a tick of a few ms is plenty for a date
+    struct timespec now{};
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if (now.tv_sec != second){
+        struct tm gmt{};
+        gmtime_r(&now.tv_sec, &gmt);
+        len = strftime(text, sizeof(text), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &gmt);
+        second = now.tv_sec;
+    }
+    return Slice{text, len};
+}
+
+char* put_decimal(char* p, uint64_t n) {
+    char digits[20];
+    int nums = 0;
+    do {
+        digits[nums++] = (char) ('0' + n % 10);
+        n /= 10;
+    } while (n > 0);
+    while (nums > 0)
+        *p++ = digits[--nums];
+    return p;
+}
@@ -4,14 +4,64 @@
 
 #include "httpd.h"
 
-Httpd::Httpd() : server_socket_(0){};
+bool Httpd::use_uring_ = true;
+
+Httpd::Httpd(int worker_nums) : server_socket_(0), epoll_fd_(-1), timer_fd_(0), pool_(nullptr), uring_(nullptr),
+                                accept_paused_(false){
+    if (worker_nums > 0)
+        pool_ = new Thread_pool(worker_nums);
+};
 
 Httpd::~Httpd() {
+    // join the workers first, they may still hold handlers in record_
+    delete pool_;
     close(server_socket_);
+    close(epoll_fd_);
+    close(timer_fd_);
+    delete uring_;
     for (auto& pair : record_){
         delete pair.second;
         pair.second = nullptr;
     }
+    for (Httpd_handler* handler : free_handlers_)
+        delete handler;
+}
+
+// set up the server, then receive and handle HTTP request in the calling thread
+void Httpd::start_up(u_short port) {
+    set_up(port, false);
+    loop();
+}
+
+// Multi-reactor mode, one Httpd per thread
+// Every reactor owns its listener, epoll fd and record_, nothing is shared between them
+// The listeners are bound to the same port with SO_REUSEPORT, so the kernel spreads new connections across reactors
+void Httpd::start_up_reactors(u_short port, int reactor_nums, int worker_nums) {
+    if (reactor_nums <= 0)
+        reactor_nums = (int) std::thread::hardware_concurrency();
+    if (reactor_nums <= 0)
+        reactor_nums = 1;
+    std::vector<Httpd*> reactors;
+    for (int i = 0; i < reactor_nums; i++){
+        Httpd* reactor = new Httpd(worker_nums);
+        // with port 0 the first reactor gets a random port, the others join it
+        port = reactor->set_up(port, true);
+        reactors.push_back(reactor);
+    }
+    LOG(LOG_INFO, "%d reactors listening on port:%d", reactor_nums, port);
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < reactor_nums; i++)
+        threads.emplace_back(&Httpd::loop, reactors[i]);
+    reactors[0]->loop();
+    for (auto& thread : threads)
+        thread.join();
+    for (auto reactor : reactors)
+        delete reactor;
+}
+
+void Httpd::set_io_uring(bool on) {
+    use_uring_ = on;
 }
 
 // create server socket
@@ -19,10 +69,24 @@ Httpd::~Httpd() {
 // listen
 // htons htonl ntohs ntohl(h = host, n = net, s = short, l = long)
 // used to ignore big endian and small endian problem
-void Httpd::start_up(u_short port) {
+// return the port actually bound, which differs from port when port == 0
+u_short Httpd::set_up(u_short port, bool reuse_port) {
     int err_code;
+    // a client closing early must not kill the whole server, let send() report EPIPE instead
+    signal(SIGPIPE, SIG_IGN);
     // create socket for server
     server_socket_ = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    // allow restarting while old connections are still in TIME_WAIT
+    int on = 1;
+    setsockopt(server_socket_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    // let several listeners share the port, each of them gets its own accept queue
+    if (reuse_port){
+        err_code = setsockopt(server_socket_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        if (err_code == -1){
+            perror("ERROR: set SO_REUSEPORT failed\n");
+            exit(-1);
+        }
+    }
     // bind socket with address
     struct sockaddr_in addr{
         .sin_family = AF_INET,
@@ -34,18 +98,18 @@ void Httpd::start_up(u_short port) {
         perror("ERROR: server socket bind failed\n");
         exit(-1);
     }
-    std::cout << "server socket bind success\n";
+    LOG(LOG_INFO, "server socket bind success");
 
     // if port == 0, the system will allocate random port
     if (port == 0){
-        std::cout << "allocating random port for the server\n";
+        LOG(LOG_INFO, "allocating random port for the server");
         socklen_t addr_len = sizeof(addr);
         err_code = getsockname(server_socket_, (struct sockaddr*)&addr, &addr_len);
         if (err_code == -1){
             perror("ERROR: get socket name failed\n");
             exit(-1);
         }
-        std::cout << "server socket bind on port:" << ntohs(addr.sin_port) << "\n";
+        LOG(LOG_INFO, "server socket bind on port:%d", ntohs(addr.sin_port));
     }
 
     // set server_socket_ non-block
@@ -56,14 +120,34 @@ void Httpd::start_up(u_short port) {
     // set server_socket_ flags, add non-block to the flags
     fcntl(server_socket_, F_SETFL, flags | O_NONBLOCK);
 
-    // create epoll fd
-    epoll_fd_ = epoll_create(EPOLL_FD_SIZE);
-    // bind event on server_socket_
-    event_.data.fd = server_socket_;
-    // use trigger mod ET
-    event_.events = EPOLLIN | EPOLLET;
-    // register event
-    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server_socket_, &event_);
+    // io_uring if the kernel has everything it needs, the first reactor to find out it doesn't turns it off for all
+    if (use_uring_){
+        uring_ = new Io_uring();
+        if (!uring_->set_up()){
+            LOG(LOG_WARN, "io_uring not available, falling back to epoll");
+            delete uring_;
+            uring_ = nullptr;
+            use_uring_ = false;
+        }
+    }
+    // the timer fd wakes the loop for timeouts, so epoll_wait can block otherwise
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd_ == -1){
+        perror("ERROR: create timer fd failed\n");
+        exit(-1);
+    }
+    // with io_uring the listener and the timer fd are armed by uring_loop()
+    if (uring_ == nullptr){
+        // create epoll fd
+        epoll_fd_ = epoll_create(EPOLL_FD_SIZE);
+        // bind event on server_socket_
+        event_.data.fd = server_socket_;
+        // use trigger mod ET
+        event_.events = EPOLLIN | EPOLLET;
+        // register event
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, server_socket_, &event_);
+        modify_event(timer_fd_, EPOLL_CTL_ADD, EPOLLIN);
+    }
 
     // waiting for the connection from client
     err_code = listen(server_socket_, SOCKET_QUEUE_SIZE);
@@ -71,36 +155,49 @@ void Httpd::start_up(u_short port) {
         perror("ERROR: server listen failed\n");
         exit(-1);
     }
-    std::cout << "server listening\n\n";
+    LOG(LOG_INFO, "server listening, events on %s", uring_ != nullptr ? "io_uring" : "epoll");
 
-    // receive and handle HTTP request
-    loop();
+    return ntohs(addr.sin_port);
 }
 
-// Based on epoll and MPM prefork mod
-// The main process is only in charge of accepting new connection
-// The rest of the work is for child process
+// Based on epoll and a worker thread pool
+// The loop thread is only in charge of accepting new connection and dispatching events
+// The rest of the work is for the workers, or for the loop thread itself when there is no pool
+// epoll_wait blocks until there is something to do, timeouts arrive as ticks of timer_fd_
 void Httpd::loop() {
+    if (uring_ != nullptr){
+        uring_loop();
+        return;
+    }
     // var for epoll
     int triggered_nums;
     // loop for accepting request
     while (true){
-        triggered_nums = epoll_wait(epoll_fd_, event_list_, SOCKET_QUEUE_SIZE, 0);
-        if (triggered_nums == -1)
+        triggered_nums = epoll_wait(epoll_fd_, event_list_, SOCKET_QUEUE_SIZE, -1);
+        if (triggered_nums == -1 && errno != EINTR)
             perror("ERROR: epoll wait failed\n");
         for (int i = 0; i < triggered_nums; i++){
             // server_socket_ triggered event EPOLLIN, accept new connection
             if (event_list_[i].data.fd == server_socket_){
                 accept_connection();
             }
+            // a second has passed with timers armed
+            else if (event_list_[i].data.fd == timer_fd_){
+                close_expired_connections();
+            }
+            // something a CGI waits for is ready
+            else if (event_list_[i].data.u64 & CGI_EVENT_TAG){
+                relay_cgi((int) (uint32_t) event_list_[i].data.u64);
+            }
             // client_socket triggered event EPOLLIN, read http request
-            else if (event_list_[i].events & EPOLLIN){
+            // an error or hang up is read as well, the read sees it and closes the connection
+            else if (event_list_[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)){
                 int client_socket = event_list_[i].data.fd;
                 if (client_socket < 0)
                     continue;
                 read_request(client_socket);
             }
-            // server_socket_ triggered event EPOLLOUT
+            // client_socket triggered event EPOLLOUT, answer the request or go on sending the responses
             else if (event_list_[i].events & EPOLLOUT){
                 int client_socket = event_list_[i].data.fd;
                 if (client_socket < 0)
@@ -111,6 +208,57 @@ void Httpd::loop() {
     }
 }
 
+// Based on io_uring, the same work as loop() in fewer syscalls
+// New connections come from one multishot accept, and a connection waiting for its request has a recv armed
+// instead of a poll, so the request is there when it completes and is answered right away
+// Everything the loop thread arms while handling a batch of completions is submitted by the next wait,
+// the thread blocks in the same call, so a keep-alive request that fits in a provided buffer costs the loop
+// no syscall but its share of that wait, and the worker the sendmsg of the response
+// Client sockets still have one request armed at a time, which its completion consumes, a poll for POLLOUT
+// like EPOLLOUT, or the recv, so there is never anything to cancel before a close
+void Httpd::uring_loop() {
+    uring_->bind_thread();
+    uring_->accept_multishot(server_socket_, URING_ACCEPT_TAG);
+    uring_->poll(timer_fd_, POLLIN, URING_TIMER_TAG, true);
+    while (true){
+        int nums = uring_->wait(uring_events_, URING_EVENT_SIZE);
+        for (int i = 0; i < nums; i++){
+            const Uring_event& event = uring_events_[i];
+            int fd = (int) (uint32_t) event.user_data;
+            switch (event.user_data & ~(uint64_t) UINT32_MAX){
+                case URING_ACCEPT_TAG:
+                    uring_accepted(event);
+                    break;
+                // a second has passed with timers armed, or the accept is waiting for fds
+                case URING_TIMER_TAG:
+                    close_expired_connections();
+                    if (!event.more())
+                        uring_->poll(timer_fd_, POLLIN, URING_TIMER_TAG, true);
+                    if (accept_paused_){
+                        accept_paused_ = false;
+                        uring_->accept_multishot(server_socket_, URING_ACCEPT_TAG);
+                    }
+                    break;
+                case CGI_EVENT_TAG:
+                    relay_cgi(fd);
+                    break;
+                case URING_RECV_TAG:
+                    read_received(fd, event);
+                    break;
+                // the client can take more of the responses, an error or hang up is read like in loop()
+                case URING_POLL_TAG:
+                    if (event.res < 0 || (event.res & (POLLIN | POLLERR | POLLHUP)))
+                        read_request(fd);
+                    else
+                        response_request(fd);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+}
+
 // Using ET mod, we don't know exactly how much connection needed to be set once triggered
 // So we use while loop to solve the problem above
 // This function will accept new connection and add it to the epoll
@@ -120,172 +268,421 @@ void Httpd::accept_connection() {
         socklen_t client_addr_size = sizeof(client_addr);
         int client_socket = accept(server_socket_, (struct sockaddr*)&client_addr, &client_addr_size);
 
-        if (client_socket == -1 && errno == EAGAIN){
-#ifdef CHECK
-            std::cout << "no more events, stop accepting\n";
-#endif
+        if (client_socket == -1){
+            LOG(LOG_DEBUG, "no more events, stop accepting");
             break;
         }
-        std::cout << "\nCLIENT SOCKET " << client_socket <<  " ACCEPTED\n";
-        // register client_socket to epoll
-        modify_event(client_socket, EPOLL_CTL_ADD, EPOLLIN | EPOLLET);
+        // responses are written as far as the socket takes them, a full socket must not block the thread
+        int flags = fcntl(client_socket, F_GETFL);
+        fcntl(client_socket, F_SETFL, flags | O_NONBLOCK);
+        open_connection(client_socket, client_addr);
     }
 }
 
-// Fork anther new process to read http request
-// Our main process only works on the epoll work
-// This function will read and parse http request from client in child process and return info needed to parent process
-// After read, the epoll trigger event will change to EPOLLOUT
-void Httpd::read_request(int& client_socket) {
-    std::cout << "CLIENT SOCKET " << client_socket <<  " READING\n";
-    // var for fork
-    pid_t pid;
-    int status;
-    Httpd_handler* handler = get_handler(client_socket);
-    // USED SHARED MEMORY TO COMPLETE IPC
-    char* p = (char*) mmap(nullptr, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, 0, 0);
-    if (p == MAP_FAILED){
-        perror("ERROR: mmap failed\n");
-        handler->send_error500();
+// This function will give a new non-blocking client socket its handler and wait for its first request
+void Httpd::open_connection(int client_socket, struct sockaddr_in& client_addr) {
+    LOG(LOG_DEBUG, "client socket %d accepted", client_socket);
+    Metrics::count(COUNTER_ACCEPTED);
+    // a response leaves in one sendmsg, Nagle would only hold back the next one, like a CGI's later chunks
+    int on = 1;
+    setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    // the handler lives as long as the connection, so it can keep data across requests
+    wait_for_request(get_handler(client_socket, client_addr));
+    // register client_socket to epoll
+    modify_event(client_socket, EPOLL_CTL_ADD, EPOLLIN | EPOLLET | EPOLLONESHOT);
+}
+
+// The multishot accept has a new connection, already non-blocking, or has stopped
+// it stops by itself on errors, and is armed again right away, or with the next tick when out of fds,
+// so it doesn't fail over and over while the fds stay in use
+// the address isn't in the completion, a multishot accept has nowhere to put one per connection
+void Httpd::uring_accepted(const Uring_event& event) {
+    if (event.res >= 0){
+        int client_socket = event.res;
+        struct sockaddr_in client_addr{};
+        socklen_t client_addr_size = sizeof(client_addr);
+        getpeername(client_socket, (struct sockaddr*)&client_addr, &client_addr_size);
+        open_connection(client_socket, client_addr);
+    }
+    else
+        LOG(LOG_WARN, "accept failed: %s", strerror(-event.res));
+    if (event.more())
         return;
+    if (event.res == -EMFILE || event.res == -ENFILE){
+        accept_paused_ = true;
+        std::lock_guard<std::mutex> lock(record_mutex_);
+        set_tick(true);
     }
+    else
+        uring_->accept_multishot(server_socket_, URING_ACCEPT_TAG);
+}
 
-    // fork child process to handle request;
-    pid = fork();
-    if (pid == -1){
-        handler->send_error500();
-        perror("ERROR: fork child process failed\n");
+// Hand the client socket over to a worker to read http request
+// Our main thread only works on the epoll work
+// The worker will read and parse http request, then change the epoll trigger event to EPOLLOUT,
+// or wait for more data with EPOLLIN again if the request is not complete yet
+// Sockets are registered with EPOLLONESHOT, so no other event of this socket shows up before the worker re-arms it
+void Httpd::read_request(int& client_socket) {
+    LOG(LOG_DEBUG, "client socket %d reading", client_socket);
+    Httpd_handler* handler = find_handler(client_socket);
+    if (handler == nullptr)
         return;
-    }
+    cancel_timer(handler);
+    // two pointers fit in std::function's inline storage, so dispatching doesn't allocate
+    dispatch([this, handler]{
+        int socket = handler->get_client_fd();
+        if (!handler->receive_request()){
+            close_connection(socket);
+            return;
+        }
+        if (handler->next_request()){
+            if (Logger::instance().enabled(LOG_DEBUG))
+                handler->check_all();
+            modify_event(socket, EPOLL_CTL_MOD, EPOLLOUT | EPOLLET | EPOLLONESHOT);
+        }
+        else{
+            wait_for_request(handler);
+            modify_event(socket, EPOLL_CTL_MOD, EPOLLIN | EPOLLET | EPOLLONESHOT);
+        }
+    });
+}
 
-    // child process, in charge of receiving and parsing http request
-    // after parsing request, send base info to the parent process for further execution work
-    if (pid == 0){
-        std::cout << "child process handling read event\n";
-        handler->receive_request();
-        handler->parse_request();
-        sent_to_parent(p, handler);
-        // unmap
-        munmap(p, BUFFER_SIZE);
-#ifdef CHECK
-        std::cout << "PARSE HTTP REQUEST RESULT:\n";
-        handler->check_all();
-#endif
-        exit(0);
+// The recv armed for a connection waiting for its request has completed
+// the data is copied into the handler and the buffer given back here in the loop thread, before anything is
+// dispatched, so the buffer ring only has to cover the receives in flight, not the requests being worked on
+// with every buffer in use the connection falls back to a poll and read_request()
+void Httpd::read_received(int client_socket, const Uring_event& event) {
+    if (event.res == -ENOBUFS){
+        uring_->poll(client_socket, POLLIN, URING_POLL_TAG | (uint32_t) client_socket);
+        return;
     }
-    // parent process, in charge of receiving msg from child process
-    else if (pid > 0){
-        char buffer[BUFFER_SIZE];
-        wait_for_child(pid, status);
-        recv_from_child(p, buffer);
-        std::string buffer_str = buffer;
-        handler->set_base_info(buffer_str);
-        modify_event(client_socket, EPOLL_CTL_MOD, EPOLLOUT | EPOLLET);
-        munmap(p, BUFFER_SIZE);
-#ifdef CHECK
-        std::cout << "Receive base info from child: " << buffer_str << "\n";
-#endif
+    Httpd_handler* handler = find_handler(client_socket);
+    bool received = handler != nullptr && event.res > 0
+                    && handler->receive_request(uring_->buffer(event.buffer_id()), event.res);
+    if (event.has_buffer())
+        uring_->recycle(event.buffer_id());
+    if (handler == nullptr)
+        return;
+    LOG(LOG_DEBUG, "client socket %d received %d bytes", client_socket, event.res);
+    if (!received){
+        close_connection(client_socket);
+        return;
     }
+    cancel_timer(handler);
+    dispatch([this, handler]{
+        if (handler->next_request()){
+            if (Logger::instance().enabled(LOG_DEBUG))
+                handler->check_all();
+            respond(handler);
+        }
+        else{
+            wait_for_request(handler);
+            modify_event(handler->get_client_fd(), EPOLL_CTL_MOD, EPOLLIN | EPOLLET | EPOLLONESHOT);
+        }
+    });
 }
 
-// Fork anther(yeah, one more another) new process to handle http request
-// The child process is in charge of executing http request and return the result to the "parent" process
-// The "parent" process will send result to the client
+// Hand the client socket over to a worker to handle http request
 void Httpd::response_request(int &client_socket) {
-    std::cout << "CLIENT SOCKET " << client_socket <<  " WRITING\n";
-    // var for fork
-    pid_t pid;
-    int status;
-    Httpd_handler* handler = record_[client_socket];
-    // fork child process to handle request;
-    pid = fork();
-    if (pid == -1)
-        perror("ERROR: fork child process failed\n");
-    // child process, in charge of responding to http request
-    if (pid == 0){
-#ifdef CHECK
-        handler->check_all();
-#endif
-        if (!handler->method_legal()){
-            handler->close_socket();
-            exit(0);
+    LOG(LOG_DEBUG, "client socket %d writing", client_socket);
+    Httpd_handler* handler = find_handler(client_socket);
+    if (handler == nullptr)
+        return;
+    cancel_timer(handler);
+    dispatch([this, handler]{
+        respond(handler);
+    });
+}
+
+// The CGI of a connection has written something or closed its output, has room for more of the body,
+// or the client has sent more of it or read some of the response
+void Httpd::relay_cgi(int cgi_epoll) {
+    Httpd_handler* handler;
+    {
+        std::lock_guard<std::mutex> lock(record_mutex_);
+        std::map<int, Httpd_handler*>::iterator it = cgi_record_.find(cgi_epoll);
+        if (it == cgi_record_.end())
+            return;
+        handler = it->second;
+        timers_.remove(handler->timer());
+    }
+    dispatch([this, handler]{
+        respond(handler);
+    });
+}
+
+// The worker executes http request and queues the result for the client
+// Pipelined requests already in the buffer are answered right away, in the order they arrived,
+// until the output queue is full or a CGI child is running
+// A CGI response is relayed piece by piece while the request body is passed to the child,
+// in between the connection waits for whichever of them can go on
+// The queue is written as far as the socket takes it, a client that doesn't read costs buffer memory,
+// not a blocked worker: the connection waits for EPOLLOUT under a write timeout and is resumed here
+// Once everything is sent the connection either goes back to waiting for the next request or is closed
+void Httpd::respond(Httpd_handler* handler) {
+    int socket = handler->get_client_fd();
+    while (true){
+        Httpd_handler::Cgi_state cgi_state = Httpd_handler::CGI_WAIT;
+        if (handler->cgi_running()){
+            cgi_state = handler->relay_cgi();
+            if (cgi_state == Httpd_handler::CGI_DONE){
+                forget_cgi(handler);
+                handler->finish_cgi();
+                handler->finish_request();
+                if (!handler->closing())
+                    handler->next_request();
+            }
+        }
+        while (!handler->cgi_running() && handler->request_ready() && !handler->output_full()){
+            if (Logger::instance().enabled(LOG_DEBUG))
+                handler->check_all();
+            if (handler->method_legal()){
+                if (handler->use_cgi())
+                    handler->execute_cgi();
+                else
+                    handler->serve_file();
+            }
+            // all FastCGI workers of the script are busy, the connection is parked until one is released
+            if (handler->fcgi_waiting() && !assign_fcgi_worker(handler))
+                return;
+            // the response comes from the child, the request is finished when it is done
+            // it gets its body and is looked at for output before anything is waited for
+            if (handler->cgi_running()){
+                cgi_state = Httpd_handler::CGI_MORE;
+                break;
+            }
+            handler->finish_request();
+            if (!handler->closing())
+                handler->next_request();
         }
-        if (handler->use_cgi()){
-            handler->execute_cgi();
+        Output_queue::Result result = handler->flush();
+        if (result == Output_queue::ERROR){
+            close_connection(socket);
+            return;
         }
-        else{
-            handler->serve_file();
+        // a CGI waits for the client to read along with everything else
+        if (handler->cgi_running()){
+            if (cgi_state == Httpd_handler::CGI_MORE)
+                continue;
+            wait_for_cgi(handler, result == Output_queue::AGAIN);
+            return;
+        }
+        if (result == Output_queue::AGAIN){
+            set_timer(handler, Timer_wheel::now() + WRITE_TIMEOUT);
+            modify_event(socket, EPOLL_CTL_MOD, EPOLLOUT | EPOLLET | EPOLLONESHOT);
+            return;
         }
-        handler->close_socket();
-        exit(0);
+        if (handler->closing()){
+            close_connection(socket);
+            return;
+        }
+        if (!handler->request_ready())
+            break;
     }
-        // parent process
-    else if (pid > 0){
-        std::cout << "created child process to handle write event\n";
-        wait_for_child(pid, status);
-        modify_event(client_socket, EPOLL_CTL_DEL, EPOLLIN | EPOLLET);
-        close(client_socket);
-        delete record_[client_socket];
-        record_[client_socket] = nullptr;
+    wait_for_request(handler);
+    modify_event(socket, EPOLL_CTL_MOD, EPOLLIN | EPOLLET | EPOLLONESHOT);
+}
+
+// This function will wait until the CGI of a connection can go on
+// everything it waits for is in the handler's own epoll fd, which is a single readable fd here,
+// so the connection still has one event armed at a time, and one worker working on it
+// the event carries CGI_EVENT_TAG, so the loop tells it from a client socket without a lookup
+// a client that has to send or read is under WRITE_TIMEOUT, a FastCGI request is timed from the first wait
+// until the worker is done with it
+void Httpd::wait_for_cgi(Httpd_handler* handler, bool output_blocked) {
+    int cgi_epoll = handler->get_cgi_epoll();
+    bool client = handler->watch_cgi(output_blocked);
+    {
+        std::lock_guard<std::mutex> lock(record_mutex_);
+        cgi_record_[cgi_epoll] = handler;
+        Timer* timer = handler->fcgi_timer();
+        if (timer != nullptr && !timer->armed()){
+            if (timers_.empty())
+                set_tick(true);
+            timers_.add(timer, Timer_wheel::now() + FCGI_TIMEOUT);
+        }
     }
+    if (client)
+        set_timer(handler, Timer_wheel::now() + WRITE_TIMEOUT);
+    struct epoll_event event{};
+    event.data.u64 = CGI_EVENT_TAG | (uint32_t) cgi_epoll;
+    event.events = EPOLLIN | EPOLLET | EPOLLONESHOT;
+    if (uring_ != nullptr){
+        uring_->poll(cgi_epoll, POLLIN, event.data.u64);
+        return;
+    }
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, cgi_epoll, &event) == -1 && errno == ENOENT)
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, cgi_epoll, &event);
+}
+
+// This function will stop waiting for the CGI of a connection, before its fds are closed
+void Httpd::forget_cgi(Httpd_handler* handler) {
+    int cgi_epoll = handler->get_cgi_epoll();
+    // an io_uring poll of it has completed already, only one thing is waited for at a time
+    if (uring_ == nullptr)
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, cgi_epoll, nullptr);
+    std::lock_guard<std::mutex> lock(record_mutex_);
+    cgi_record_.erase(cgi_epoll);
+    Timer* timer = handler->fcgi_timer();
+    if (timer != nullptr)
+        timers_.remove(timer);
+}
+
+// This function will give a .fcgi request a worker of the script, right away or once one is released
+// return false if the request waits in the pool's queue, the releasing thread resumes the connection
+bool Httpd::assign_fcgi_worker(Httpd_handler* handler) {
+    Fcgi_worker* worker;
+    bool ready = Fcgi_pool::instance().acquire(handler->get_path(), worker, [this, handler](Fcgi_worker* worker){
+        handler->start_fcgi(worker);
+        dispatch([this, handler]{
+            respond(handler);
+        });
+    });
+    if (ready)
+        handler->start_fcgi(worker);
+    return ready;
+}
+
+// This function will arm the timeout of a connection, the tick starts when the first timer is armed
+void Httpd::set_timer(Httpd_handler* handler, long expire) {
+    std::lock_guard<std::mutex> lock(record_mutex_);
+    if (timers_.empty())
+        set_tick(true);
+    timers_.add(handler->timer(), expire);
+}
+
+// This function will stop the timeout of a connection that is being worked on
+void Httpd::cancel_timer(Httpd_handler* handler) {
+    std::lock_guard<std::mutex> lock(record_mutex_);
+    timers_.remove(handler->timer());
 }
 
-// Our HTTPD server has a lot of "fork" action
-// This function will help the parent process to wait for the child to complete
-void Httpd::wait_for_child(int &pid, int &status) {
-    waitpid(pid, &status, 0);
-    if (WEXITSTATUS(status) == 0){
-        std::cout << "child process exit normally\n";
-    }else
-        std::cout << "child process exit abnormally, exit signal code:" << WSTOPSIG(status) << "\n";
+// A connection waiting for the client either sits between requests or has received part of one
+// the first gets KEEP_ALIVE_TIMEOUT from now, the second REQUEST_TIMEOUT from its first byte
+// the deadline of a partial request never moves, so trickling it in byte by byte doesn't keep the fd
+void Httpd::wait_for_request(Httpd_handler* handler) {
+    long request_start = handler->request_start();
+    if (request_start != 0)
+        set_timer(handler, request_start + REQUEST_TIMEOUT);
+    else
+        set_timer(handler, Timer_wheel::now() + KEEP_ALIVE_TIMEOUT);
 }
 
-// This function will send the needed http parsing result to the parent process for child process
-void Httpd::sent_to_parent(char* p, Httpd_handler* handler) {
-    std::string ret = handler->get_base_info();
-    const char *info = ret.c_str();
-    while (*info != '\0'){
-        *p = *info;
-        p++;
-        info++;
+// This function will start or stop the one second tick of timer_fd_, record_mutex_ is held
+void Httpd::set_tick(bool on) {
+    struct itimerspec spec{};
+    if (on){
+        spec.it_value.tv_sec = 1;
+        spec.it_interval.tv_sec = 1;
     }
-    *p = '\0';
+    timerfd_settime(timer_fd_, 0, &spec, nullptr);
 }
 
-// This function will receive the needed http parsing result from the child process for parent process
-void Httpd::recv_from_child(char *p, char* buffer) {
-    int index = 0;
-    while (*p != '\0'){
-        buffer[index] = *p;
-        index++;
-        p++;
+// Shut down connections whose timer has expired
+// shutdown() instead of close() makes the socket readable, so whoever owns the connection next sees EOF and closes it
+// record_mutex_ is held, and close_connection() disarms the timer before closing, so every fd here is still ours
+void Httpd::close_expired_connections() {
+    uint64_t ticks;
+    while (read(timer_fd_, &ticks, sizeof(ticks)) < 0 && errno == EINTR);
+    std::lock_guard<std::mutex> lock(record_mutex_);
+    timers_.advance(Timer_wheel::now(), expired_);
+    for (int fd : expired_){
+        LOG(LOG_DEBUG, "client socket %d timed out", fd);
+        shutdown(fd, SHUT_RDWR);
     }
-    buffer[index] = '\0';
+    expired_.clear();
+    if (timers_.empty())
+        set_tick(false);
 }
 
-// This function will do something for the current socket based on the operation and events
-void Httpd::modify_event(int& socket, int op, uint32_t events) {
-    event_.data.fd = socket;
-    event_.events = events;
-    epoll_ctl(epoll_fd_, op, socket, &event_);
+// This function will run the task on the pool, or right here if this reactor has no pool
+void Httpd::dispatch(std::function<void()> task) {
+    if (pool_ != nullptr)
+        pool_->submit(std::move(task));
+    else
+        task();
 }
 
-// This function will get httpd_handler based on the client socket using func getsockname
-Httpd_handler* Httpd::get_handler(int& client_socket) {
-    struct sockaddr_in client_addr{};
-    socklen_t addr_len = sizeof(client_addr);
-    int err_code = getsockname(client_socket, (struct sockaddr*)&client_addr, &addr_len);
+// This function will remove the socket from epoll, close it and put its handler back to the free list
+void Httpd::close_connection(int client_socket) {
+    modify_event(client_socket, EPOLL_CTL_DEL, 0);
+    Httpd_handler* handler = find_handler(client_socket);
+    // a CGI child still running is killed when the handler is reset
+    if (handler != nullptr && handler->cgi_running())
+        forget_cgi(handler);
+    handler = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(record_mutex_);
+        std::map<int, Httpd_handler*>::iterator it = record_.find(client_socket);
+        if (it != record_.end()){
+            handler = it->second;
+            timers_.remove(handler->timer());
+            record_.erase(it);
+            Metrics::count(COUNTER_CLOSED);
+        }
+    }
+    // close after erasing, otherwise accept() may reuse the fd while the old record is still there
+    close(client_socket);
+    if (handler == nullptr)
+        return;
+    handler->reset();
+    std::lock_guard<std::mutex> lock(record_mutex_);
+    if (free_handlers_.size() < HANDLER_POOL_SIZE)
+        free_handlers_.push_back(handler);
+    else
+        delete handler;
+}
 
-    if (err_code == -1){
-        perror("ERROR: get socket name failed\n");
-        exit(-1);
+// This function will do something for the current socket based on the operation and events
+// Workers call it as well, so it uses its own epoll_event instead of event_
+// With io_uring a connection waiting for EPOLLIN gets a recv into a provided buffer, one waiting for EPOLLOUT a poll,
+// both complete once, like EPOLLONESHOT, and nothing is left to delete
+void Httpd::modify_event(int socket, int op, uint32_t events) {
+    if (uring_ != nullptr){
+        if (op == EPOLL_CTL_DEL)
+            return;
+        if (events & EPOLLIN)
+            uring_->recv(socket, URING_RECV_TAG | (uint32_t) socket);
+        else
+            uring_->poll(socket, POLLOUT, URING_POLL_TAG | (uint32_t) socket);
+        return;
     }
+    struct epoll_event event{};
+    event.data.fd = socket;
+    event.events = events;
+    epoll_ctl(epoll_fd_, op, socket, &event);
+}
 
-    Httpd_handler* handler = new Httpd_handler(client_socket, client_addr);
-    record_[client_socket] = handler;
+// This function will give a newly accepted client socket a handler, a recycled one if there is any
+// a recycled handler still has the receive buffer and arena block of its last connection
+Httpd_handler* Httpd::get_handler(int& client_socket, struct sockaddr_in& client_addr) {
+    std::lock_guard<std::mutex> lock(record_mutex_);
+    Httpd_handler* handler;
+    if (!free_handlers_.empty()){
+        handler = free_handlers_.back();
+        free_handlers_.pop_back();
+        handler->open_connection(client_socket, client_addr);
+    }
+    else
+        handler = new Httpd_handler(client_socket, client_addr);
+    Httpd_handler*& record = record_[client_socket];
+    if (record != nullptr){
+        timers_.remove(record->timer());
+        delete record;
+    }
+    record = handler;
 
     return handler;
 }
 
+// This function will get the httpd_handler created by accept_connection, nullptr if there is none
+Httpd_handler* Httpd::find_handler(int client_socket) {
+    std::lock_guard<std::mutex> lock(record_mutex_);
+    std::map<int, Httpd_handler*>::iterator it = record_.find(client_socket);
+    if (it == record_.end())
+        return nullptr;
+    return it->second;
+}
+
 
 
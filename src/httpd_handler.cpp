@@ -4,31 +4,26 @@
 
 #include "httpd_handler.h"
 
+long Httpd_handler::max_body_ = MAX_BODY_SIZE;
+
 Httpd_handler::Httpd_handler(){
     client_fd_ = 0;
-    path_ = "/home/wwd/CLionProjects/MyHttpd/htdocs";
 }
 
 Httpd_handler::Httpd_handler(int& fd, struct  sockaddr_in& addr){
-    client_fd_ = fd;
-    client_addr_ = addr;
-    path_ = "/home/wwd/CLionProjects/MyHttpd/htdocs";
-}
-
-Httpd_handler::Httpd_handler(const Httpd_handler &copy) {
-    client_fd_ = copy.client_fd_;
-    client_addr_ = copy.client_addr_;
-    method_ = copy.method_;
-    url_ = copy.url_;
-    ver_ = copy.ver_;
-    header_ = copy.header_;
-    query_ = copy.query_;
-    params_ = copy.params_;
-    path_ = copy.path_;
+    open_connection(fd, addr);
 }
 
 Httpd_handler::~Httpd_handler(){
     Httpd_handler::reset();
+    free(in_buf_);
+}
+
+// take a new connection, a recycled handler keeps its buffers from the last one
+void Httpd_handler::open_connection(int fd, struct sockaddr_in& addr) {
+    client_fd_ = fd;
+    client_addr_ = addr;
+    timer_.fd = fd;
 }
 
 void Httpd_handler::close_socket() const {
@@ -36,174 +31,443 @@ void Httpd_handler::close_socket() const {
         close(client_fd_);
 }
 
+// forget the connection so the handler can be recycled for another one
+// the receive buffer and the arena's first block stay allocated
 void Httpd_handler::reset() {
     client_fd_ = 0;
+    in_start_ = in_end_ = 0;
+    served_nums_ = 0;
+    request_start_ = 0;
+    parsed_ns_ = 0;
+    timer_.fd = -1;
+    closing_ = false;
+    fcgi_wait_ = false;
+    finish_cgi(true);
+    out_.clear();
+    response_mark_ = out_.appended();
+    reset_request();
+}
+
+void Httpd_handler::set_max_body(long size) {
+    max_body_ = size;
 }
 
-// receive the whole http request and store it in string buffer_str_
-// and divide the string by line and store them into vector buffer_by_line_
-void Httpd_handler::receive_request() {
+// receive what the client has sent so far and append it to in_buf_
+// a request may arrive in several pieces, and several pipelined requests may arrive in one piece
+// return false if the client closed the connection
+bool Httpd_handler::receive_request() {
     int num_read;
-    char buffer[MAX_BUF_SIZE];
-    if (client_fd_ == 0)
+    if (client_fd_ == 0){
         perror("ERROR: no client socket accept");
-    // recv based on non-block socket
-    while ((num_read = recv(client_fd_, buffer, sizeof(buffer), 0)) < 0) {
+        return false;
+    }
+    if (!make_input_room(MAX_BUF_SIZE))
+        return false;
+    // recv based on non-block socket, nothing to read yet just means waiting for the next event
+    while ((num_read = recv(client_fd_, in_buf_ + in_end_, in_cap_ - in_end_, 0)) < 0) {
         if (errno == EWOULDBLOCK)
-            std::cout << "waiting for data\n";
-    }
-    buffer[num_read] = '\0';
-    int substr_start = 0;
-    buffer_str_ = buffer;
-    // get request line and header
-    for (int i = 0; i < buffer_str_.size(); i++){
-        if (buffer_str_[i] == '\n'){
-            std::string temp = buffer_str_.substr(substr_start, i - substr_start);
-            if (temp == "\r\n")
-                break;
-            substr_start = i + 1;
-            buffer_byline_.push_back(temp);
-        }
+            return true;
+        if (errno != EINTR)
+            return false;
     }
-#ifdef DEBUG
-    std::cout << "\nINCOMING HTTP REQUEST:\n" << buffer_str_ << std::endl;
-#endif
+    if (num_read == 0)
+        return false;
+    if (request_start_ == 0)
+        request_start_ = Timer_wheel::now();
+    in_end_ += num_read;
+    return true;
+}
+
+// take len bytes the loop has already received for this connection, like from an io_uring provided buffer
+bool Httpd_handler::receive_request(const char* data, size_t len) {
+    if (!make_input_room(len))
+        return false;
+    memcpy(in_buf_ + in_end_, data, len);
+    if (request_start_ == 0)
+        request_start_ = Timer_wheel::now();
+    in_end_ += len;
+    return true;
+}
+
+// make room for len more bytes, first by moving the current request to the front, then by growing
+// the parser only keeps offsets, so moving the request is fine
+bool Httpd_handler::make_input_room(size_t len) {
+    if (in_cap_ - in_end_ >= len)
+        return true;
+    if (in_start_ > 0){
+        memmove(in_buf_, in_buf_ + in_start_, in_end_ - in_start_);
+        in_end_ -= in_start_;
+        in_start_ = 0;
+    }
+    if (in_cap_ - in_end_ < len){
+        size_t new_cap = std::max(in_cap_ * 2, in_end_ + len);
+        char* new_buf = (char*) realloc(in_buf_, new_cap);
+        if (new_buf == nullptr)
+            return false;
+        in_buf_ = new_buf;
+        in_cap_ = new_cap;
+    }
+    return true;
 }
 
-// functions below are added keywords "inline", so can't directly use them in class Httpd
-void Httpd_handler::parse_request() {
+// feed the newly received bytes to parser_, and check whether in_buf_ now holds a complete request head
+// return false if more data is needed
+// the body isn't waited for, a CGI reads it as it arrives and anything else skips it in finish_request()
+// a malformed request also returns true, marked as bad request so it gets a 400
+bool Httpd_handler::next_request() {
+    uint64_t start = Metrics::now_ns();
+    size_t received = in_end_ - in_start_;
+    Http_parser::State state = parser_.parse(in_buf_ + in_start_, received);
+    if (state == Http_parser::NEED_MORE)
+        return false;
+    request_ready_ = true;
+    if (state == Http_parser::ERROR){
+        bad_request_ = true;
+        body_pos_ = in_end_;
+        parsed(start);
+        return true;
+    }
+
+    // chunked has to be the only coding, and a Content-Length beside it could smuggle in another request
+    Slice transfer_encoding = parser_.header(HEADER_TRANSFER_ENCODING);
+    bool chunked = !transfer_encoding.empty();
+    long content_length = parser_.content_length();
+    if (chunked && (!transfer_encoding.equals_nocase("chunked") || content_length >= 0))
+        bad_request_ = true;
+    too_large_ = content_length > max_body_;
+    body_.reset(content_length, chunked);
+    body_pos_ = in_start_ + parser_.head_size();
+    if (chunked || in_end_ - body_pos_ < (size_t) std::max(content_length, 0L))
+        make_body_room();
+    LOG(LOG_DEBUG, "INCOMING HTTP REQUEST:\n%.*s", (int) parser_.head_size(), in_buf_ + in_start_);
     parse_request_line();
     parse_header();
     parse_body();
+    // nothing after a bad request can be trusted, it is all dropped with it
+    if (bad_request_){
+        body_.reset(-1, false);
+        body_pos_ = in_end_;
+    }
+    keep_alive_ = wants_keep_alive();
+    parsed(start);
+    return true;
 }
 
-// parse http request's first line, including method, url
-// and if the method is GET, parse its query
-void Httpd_handler::parse_request_line() {
-    std::string request_line = buffer_byline_[0];
-    int count = 0, substr_start = 0;
-    for (int i = 0; i < request_line.size(); i++){
-        if (request_line[i] == ' '){
-            // parsing method
-            if (count == 0){
-                method_ = request_line.substr(substr_start, i - substr_start);
-                count++;
-                substr_start = i + 1;
-            }
-            // parsing url
-            else if (count == 1){
-                url_ = request_line.substr(substr_start, i - substr_start);
-                // parsing query
-                int index = url_.find('?');
-                if (index != std::string::npos){
-                    parse_params(url_.substr(index + 1, url_.size() - index - 1), query_);
-                    url_ = url_.substr(0, index);
-                }
-                substr_start = i + 1;
-                break;
-            }
+// a request parsed since start, its time to the first response byte runs from now
+void Httpd_handler::parsed(uint64_t start) {
+    uint64_t now = Metrics::now_ns();
+    Metrics::record(HISTOGRAM_PARSE, now - start);
+    if (parsed_ns_ == 0)
+        parsed_ns_ = now;
+}
+
+// a body still on its way is received behind the head, which must not move from now on, the slices point into it
+// so the request moves to the front now, with BODY_BUF_SIZE of room behind it
+void Httpd_handler::make_body_room() {
+    if (in_start_ > 0){
+        memmove(in_buf_, in_buf_ + in_start_, in_end_ - in_start_);
+        in_end_ -= in_start_;
+        body_pos_ -= in_start_;
+        in_start_ = 0;
+    }
+    if (in_cap_ - in_end_ < BODY_BUF_SIZE){
+        char* new_buf = (char*) realloc(in_buf_, in_end_ + BODY_BUF_SIZE);
+        if (new_buf != nullptr){
+            in_buf_ = new_buf;
+            in_cap_ = in_end_ + BODY_BUF_SIZE;
+        }
+    }
+    // the parser's results follow the move
+    parser_.parse(in_buf_, in_end_);
+}
+
+// receive more of the body, only called once everything received so far is passed on
+// so the space behind the head is free again
+// return 1 if something arrived, 0 if nothing has yet, -1 if the client is gone
+int Httpd_handler::receive_body() {
+    in_end_ = body_pos_ = in_start_ + parser_.head_size();
+    if (in_end_ == in_cap_)
+        return -1;
+    ssize_t num_read;
+    while ((num_read = recv(client_fd_, in_buf_ + in_end_, in_cap_ - in_end_, 0)) < 0 && errno == EINTR);
+    if (num_read < 0 && errno == EWOULDBLOCK)
+        return 0;
+    if (num_read <= 0)
+        return -1;
+    in_end_ += num_read;
+    return 1;
+}
+
+// step over the part of a body nobody reads that has arrived
+// the rest can't be told from the next request without reading it, the connection is closed after the response
+void Httpd_handler::skip_body() {
+    size_t data_len;
+    while (body_.state() == Body_reader::BODY){
+        size_t framing = body_.next(in_buf_ + body_pos_, in_end_ - body_pos_, data_len);
+        body_.consume(data_len);
+        body_pos_ += framing + data_len;
+        if (framing == 0 && data_len == 0)
+            break;
+    }
+    if (body_.state() != Body_reader::DONE)
+        keep_alive_ = false;
+}
+
+// drop the request just served from in_buf_ and clear its parse result
+// whatever follows it in in_buf_ is the next pipelined request, unless the response closes the connection
+void Httpd_handler::finish_request() {
+    skip_body();
+    if (Logger::instance().access_enabled())
+        log_access();
+    response_mark_ = out_.appended();
+    closing_ = !keep_alive_;
+    in_start_ = body_pos_;
+    if (in_start_ == in_end_)
+        in_start_ = in_end_ = 0;
+    // a pipelined request already started arriving, its time runs from now
+    request_start_ = in_start_ == in_end_ ? 0 : Timer_wheel::now();
+    served_nums_++;
+    reset_request();
+}
+
+// everything the request allocated goes away with the arena at once
+void Httpd_handler::reset_request() {
+    parser_.reset();
+    method_ = url_ = ver_ = Slice{"", 0};
+    query_.clear();
+    params_.clear();
+    path_.clear();
+    arena_.reset();
+    body_.reset(-1, false);
+    body_pos_ = 0;
+    bad_request_ = false;
+    too_large_ = false;
+    keep_alive_ = false;
+    request_ready_ = false;
+    status_code_ = 0;
+}
+
+// copy s to p as the inside of a quoted log field, quotes, backslashes and control bytes escaped, stop before end
+static char* put_escaped(char* p, char* end, Slice s) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < s.len && p + 4 < end; i++){
+        unsigned char c = (unsigned char) s.data[i];
+        if (c == '"' || c == '\\'){
+            *p++ = '\\';
+            *p++ = (char) c;
         }
+        else if (c < 0x20 || c == 0x7f){
+            *p++ = '\\';
+            *p++ = 'x';
+            *p++ = hex[c >> 4];
+            *p++ = hex[c & 15];
+        }
+        else
+            *p++ = (char) c;
+    }
+    return p;
+}
+
+// a field of the log line, "-" if the request has no such thing
+static char* put_field(char* p, char* end, Slice s) {
+    if (s.data == nullptr || s.empty())
+        return put_slice(p, LITERAL_SLICE("-"));
+    return put_escaped(p, end, s);
+}
+
+// one line of the Combined Log Format for the request just served, the size is the bytes of the whole response
+// the line is put together in a per-thread buffer and handed to the logger, the writer thread does the I/O
+void Httpd_handler::log_access() {
+    static thread_local char line[LOG_LINE_MAX];
+    char* end = line + LOG_LINE_MAX - 64;
+    char* p = line;
+    char addr[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &client_addr_.sin_addr, addr, sizeof(addr));
+    p = put_slice(p, Slice{addr, strlen(addr)});
+    p = put_slice(p, LITERAL_SLICE(" - - "));
+    p = put_slice(p, Slice{log_time(), LITERAL_LEN("[17/Oct/2026:08:12:31 +0000]")});
+    p = put_slice(p, LITERAL_SLICE(" \""));
+    // the request line isn't there when it couldn't be parsed
+    if (!method_.empty()){
+        p = put_escaped(p, end, method_);
+        *p++ = ' ';
+        p = put_escaped(p, end, parser_.target());
+        *p++ = ' ';
+        p = put_escaped(p, end, ver_);
     }
+    else
+        *p++ = '-';
+    p = put_slice(p, LITERAL_SLICE("\" "));
+    p = put_decimal(p, status_code_);
+    *p++ = ' ';
+    p = put_decimal(p, out_.appended() - response_mark_);
+    p = put_slice(p, LITERAL_SLICE(" \""));
+    p = put_field(p, end, parser_.header(HEADER_REFERER));
+    p = put_slice(p, LITERAL_SLICE("\" \""));
+    p = put_field(p, end, parser_.header(HEADER_USER_AGENT));
+    p = put_slice(p, LITERAL_SLICE("\"\n"));
+    Logger::instance().access(line, p - line);
+}
+
+// the status of the response to the current request, counted by status and kept for the access log
+void Httpd_handler::set_status(int code) {
+    status_code_ = code;
+    Metrics::count_response(status_id(code));
+}
+
+// HTTP/1.1 keeps the connection unless asked to close, HTTP/1.0 closes it unless asked to keep it
+bool Httpd_handler::wants_keep_alive() {
+    if (bad_request_ || served_nums_ + 1 >= KEEP_ALIVE_MAX_REQUESTS)
+        return false;
+    Slice connection = parser_.header(HEADER_CONNECTION);
+    if (ver_.equals("HTTP/1.1"))
+        return !connection.has_token("close");
+    return ver_.equals("HTTP/1.0") && connection.has_token("keep-alive");
+}
+
+bool Httpd_handler::keep_alive() const {
+    return keep_alive_;
+}
+
+bool Httpd_handler::request_ready() const {
+    return request_ready_;
+}
+
+bool Httpd_handler::closing() const {
+    return closing_;
+}
+
+// 0 if the connection is idle between requests
+long Httpd_handler::request_start() const {
+    return request_start_;
+}
+
+Timer* Httpd_handler::timer() {
+    return &timer_;
+}
+
+int Httpd_handler::get_client_fd() const {
+    return client_fd_;
+}
+
+// the parse_* functions below are called by the handler itself and by the microbenchmark
+// the ones added keywords "inline" can't directly be used in class Httpd
+// take http request's first line from parser_, including method, url
+// and if the method is GET, parse its query
+void Httpd_handler::parse_request_line() {
+    method_ = parser_.method();
+    Slice target = parser_.target();
+    const char* query = find_char(target.data, target.data + target.len, '?');
+    url_ = Slice{target.data, (size_t) (query - target.data)};
+    // parsing query
+    if (query != target.data + target.len)
+        parse_params(Slice{query + 1, (size_t) (target.data + target.len - query - 1)}, query_);
     // parse version of HTTP
-    ver_ = request_line.substr(substr_start, request_line.size() - substr_start);
-#ifdef DEBUG
-    std::cout << "URL:" << url_ << std::endl;
-    std::cout << "QUERY:\n" ;
-    check_maps(query_);
-    std::cout << "VER:" << ver_ << std::endl;
-#endif
+    ver_ = parser_.version();
+    if (Logger::instance().enabled(LOG_DEBUG)){
+        LOG(LOG_DEBUG, "URL:%.*s", (int) url_.len, url_.data);
+        LOG(LOG_DEBUG, "QUERY:");
+        check_params(query_);
+        LOG(LOG_DEBUG, "VER:%.*s", (int) ver_.len, ver_.data);
+    }
 }
 
-// parse header, store info into a map
+// header fields stay in parser_'s flat array, look up the ones deciding how to respond
 void Httpd_handler::parse_header() {
-    for (int i = 1; i < buffer_byline_.size(); i++){
-        std::string key, value;
-        for (int j = 0; j < buffer_byline_[i].size(); j++){
-            if (buffer_byline_[i][j] == ':'){
-                key = buffer_byline_[i].substr(0, j);
-                value = buffer_byline_[i].substr(j + 2, buffer_byline_[i].size() - j - 1);
-                header_[key] = value;
-                break;
-            }
-        }
+    keep_alive_ = wants_keep_alive();
+    if (Logger::instance().enabled(LOG_DEBUG)){
+        LOG(LOG_DEBUG, "HEAD:");
+        check_headers();
     }
-#ifdef DEBUG
-    std::cout << "HEAD:\n" ;
-    check_maps(header_);
-#endif
 }
 
-// if http's method is POST, parse parameters in body, store parameters into a map called params_
+// if http's method is POST, parse parameters in a form body that has already arrived, store parameters into params_
+// a bigger body is left to the CGI reading it
+// a POST with neither Content-Length nor a chunked body is marked as bad request, it is answered with 400
 void Httpd_handler::parse_body() {
-    int content_length = get_content_length();
-    if (content_length == -1){
-        if (is_POST())
-            send_error400();
+    long content_length = get_content_length();
+    if (content_length < 0){
+        if (is_POST() && parser_.header(HEADER_TRANSFER_ENCODING).empty())
+            bad_request_ = true;
         return;
     }
-    std::string body = buffer_str_.substr(buffer_str_.size() - content_length, content_length);
+    if (content_length > MAX_REQUEST_SIZE || in_end_ - body_pos_ < (size_t) content_length)
+        return;
+    Slice body{in_buf_ + body_pos_, (size_t) content_length};
     parse_params(body, params_);
-#ifdef DEBUG
-    std::cout << "BODY: " << body << std::endl;
-    std::cout << "PUT PARAMS:\n" ;
-    check_maps(params_);
-#endif
+    if (Logger::instance().enabled(LOG_DEBUG)){
+        LOG(LOG_DEBUG, "BODY: %.*s", (int) body.len, body.data);
+        LOG(LOG_DEBUG, "PUT PARAMS:");
+        check_params(params_);
+    }
 }
 
-// parameters from GET AND POST are stored in different map
+// parameters from GET AND POST are stored in different lists
 // create a function so that the function can be reused to handle situation above
-void Httpd_handler::parse_params(const std::string& params_str, std::map<std::string, std::string>&params_map) {
-    int substr_start = 0;
-    std::string key, value;
-    for (int i = 0; i < params_str.size(); i++){
-        if (params_str[i] == '='){
-            key = params_str.substr(substr_start, i - substr_start);
-            substr_start = i + 1;
-        }else if (params_str[i] == '&'){
-            value = params_str.substr(substr_start, i - substr_start);
-            substr_start = i + 1;
-            params_map[key] = value;
+// a name without '=' gets an empty value
+void Httpd_handler::parse_params(Slice params_str, Param_list& params) {
+    const char* p = params_str.data;
+    const char* end = params_str.data + params_str.len;
+    while (p < end){
+        const char* pair_end = find_char(p, end, '&');
+        const char* equal = find_char(p, pair_end, '=');
+        if (equal != p){
+            const char* value = equal == pair_end ? pair_end : equal + 1;
+            params.add(Slice{p, (size_t) (equal - p)}, Slice{value, (size_t) (pair_end - value)});
         }
+        p = pair_end + 1;
     }
-    params_map[key] = params_str.substr(substr_start, params_str.size() - substr_start);
 }
 
-// FOR DEBUG use, print maps
-void Httpd_handler::check_maps(std::map<std::string, std::string>& params_map){
-    for (auto& params : params_map)
-        std::cout << params.first << ":" << params.second << std::endl;
+// FOR DEBUG use, print params
+void Httpd_handler::check_params(const Param_list& params){
+    for (int i = 0; i < params.size(); i++)
+        LOG(LOG_DEBUG, "%.*s:%.*s", (int) params.name(i).len, params.name(i).data,
+            (int) params.value(i).len, params.value(i).data);
+}
+
+// FOR DEBUG use, print header fields
+void Httpd_handler::check_headers(){
+    for (int i = 0; i < parser_.header_nums(); i++)
+        LOG(LOG_DEBUG, "%.*s:%.*s", (int) parser_.header_name(i).len, parser_.header_name(i).data,
+            (int) parser_.header_value(i).len, parser_.header_value(i).data);
 }
 
-// For POST, get header info Content-Length
+// For POST, get header info Content-Length, -1 if there is none
 // get parameters based on Content-Length
-int Httpd_handler::get_content_length() {
-    std::map<std::string, std::string>::iterator result = header_.find("Content-Length");
-    if (result != header_.end())
-        return atoi(result->second.c_str());
-    return -1;
+long Httpd_handler::get_content_length() {
+    return parser_.content_length();
 }
 
 bool Httpd_handler::is_POST() {
-    return method_ == "POST";
+    return method_.equals("POST");
 }
 
 bool Httpd_handler::is_GET() {
-    return method_ == "GET";
+    return method_.equals("GET");
 }
 
 // FOR DEBUG
 void Httpd_handler::check_all() {
-    std::cout << "CHECKING ALL INFO IN HTTPD_HANDLER\n";
-    std::cout << "URL:" << url_ << "\n";
-    std::cout << "METHOD:" << method_ << "\n";
-    std::cout << "VER:" << ver_ << "\n";
-    check_maps(header_);
-    check_maps(query_);
-    check_maps(params_);
+    LOG(LOG_DEBUG, "CHECKING ALL INFO IN HTTPD_HANDLER");
+    LOG(LOG_DEBUG, "URL:%.*s", (int) url_.len, url_.data);
+    LOG(LOG_DEBUG, "METHOD:%.*s", (int) method_.len, method_.data);
+    LOG(LOG_DEBUG, "VER:%.*s", (int) ver_.len, ver_.data);
+    check_headers();
+    check_params(query_);
+    check_params(params_);
 }
 
-// This function will check if the method is POST or GET
+// This function will check if the request is well-formed and the method is POST or GET
 bool Httpd_handler::method_legal() {
+    if (bad_request_){
+        send_error400();
+        return false;
+    }
+    if (too_large_){
+        send_error413();
+        return false;
+    }
     if (!is_POST() && !is_GET()){
         send_error501();
         return false;
@@ -212,135 +476,209 @@ bool Httpd_handler::method_legal() {
 }
 
 // This function will judge whether execution in response
-// only execute cgi when the url contains /*.cgi,
+// only execute cgi when the url contains /*.cgi, or /*.fcgi for a FastCGI worker
 bool Httpd_handler::use_cgi() {
-    if (strstr(url_.c_str(), ".cgi") != nullptr)
+    if (memmem(url_.data, url_.len, ".cgi", 4) != nullptr || memmem(url_.data, url_.len, ".fcgi", 5) != nullptr)
         return true;
     return false;
 }
 
-void Httpd_handler::send_status200() const {
-    std::string s = std::string(STATUS_200) +
-                    SERVER_STRING +
-                    "Content-Type: text/html\r\n" +
-                    "\r\n";
-    while (send(client_fd_, s.c_str(), strlen(s.c_str()), 0) < 0){
-        if (errno == EWOULDBLOCK)
-            std::cout << "buffer is full, keep trying\n";
+// write as much of the queued responses as the socket takes, the rest waits for EPOLLOUT
+Output_queue::Result Httpd_handler::flush() {
+    size_t pending = out_.pending();
+    Output_queue::Result result = out_.flush(client_fd_);
+    size_t num_sent = pending - out_.pending();
+    if (num_sent > 0){
+        Metrics::count(COUNTER_BYTES_SENT, num_sent);
+        if (parsed_ns_ != 0){
+            Metrics::record(HISTOGRAM_FIRST_BYTE, Metrics::now_ns() - parsed_ns_);
+            parsed_ns_ = 0;
+        }
     }
+    return result;
 }
 
-void Httpd_handler::send_error400() const {
-    std::string s = std::string(STATUS_400) +
-               "Content-type: text/html\r\n" +
-               "\r\n" +
-               "<P>Your browser sent a bad request, " +
-               "such as a POST without a Content-Length.\r\n";
-    while (send(client_fd_, s.c_str(), strlen(s.c_str()), 0) < 0){
-        if (errno == EWOULDBLOCK)
-            std::cout << "buffer is full, keep trying\n";
-    }
+// a client that doesn't read its responses gets no more of them answered, its requests wait in in_buf_
+bool Httpd_handler::output_full() const {
+    return out_.full();
 }
 
-void Httpd_handler::send_error404() const {
-    std::string s = std::string(STATUS_404) +
-               SERVER_STRING +
-               "Content-type: text/html\r\n" +
-               "\r\n" +
-               "<HTML><TITLE>Not Found</TITLE>\r\n" +
-               "<BODY><P>The server could not fulfill\r\n" +
-               "your request because the resource specified\r\n" +
-               "is unavailable or nonexistent.\r\n" +
-               "</BODY></HTML>\r\n";
-    while (send(client_fd_, s.c_str(), strlen(s.c_str()), 0) < 0){
-        if (errno == EWOULDBLOCK)
-            std::cout << "buffer is full, keep trying\n";
+// the headers that change from response to response, up to the blank line ending the header
+// Content-Type and Content-Length are added when asked for, content_length < 0 means the length is unknown
+// they are put together in a per-thread buffer with no formatting, and copied into the queue in one piece
+void Httpd_handler::append_header_tail(bool content_type, long content_length) {
+    static thread_local char buf[HEADER_TAIL_SIZE];
+    char* p = buf;
+    if (content_type)
+        p = put_slice(p, LITERAL_SLICE("Content-Type: text/html\r\n"));
+    if (content_length >= 0){
+        p = put_slice(p, LITERAL_SLICE("Content-Length: "));
+        p = put_decimal(p, content_length);
+        p = put_slice(p, LITERAL_SLICE("\r\n"));
     }
+    p = put_slice(p, date_header());
+    if (keep_alive_)
+        p = put_slice(p, LITERAL_SLICE("Connection: keep-alive\r\n\r\n"));
+    else
+        p = put_slice(p, LITERAL_SLICE("Connection: close\r\n\r\n"));
+    out_.append(buf, p - buf);
 }
 
-void Httpd_handler::send_error500() const {
-    std::string s = std::string(STATUS_500) +
-               "Content-Type: text/html\r\n" +
-               "\r\n" +
-               "<P>Server Error.\r\n";
-    while (send(client_fd_, s.c_str(), strlen(s.c_str()), 0) < 0){
-        if (errno == EWOULDBLOCK)
-            std::cout << "buffer is full, keep trying\n";
-    }
+// the status line and Server header are queued from the table where they are, only the tail is copied
+void Httpd_handler::send_head(Status_id status, long content_length) {
+    const Http_status& entry = http_status(status);
+    set_status(entry.code);
+    out_.append_static(entry.head.data, entry.head.len);
+    append_header_tail(true, content_length);
 }
 
-void Httpd_handler::send_error501() const {
-    std::string s = std::string(STATUS_501) +
-            SERVER_STRING +
-            "Content-Type: text/html\r\n" +
-            "\r\n" +
-            "<HTML><HEAD><TITLE>Method Not Implemented\r\n" +
-            "</TITLE></HEAD>\r\n" +
-            "<BODY><P>HTTP request method not supported.\r\n" +
-            "</BODY></HTML>\r\n";
-    while (send(client_fd_, s.c_str(), strlen(s.c_str()), 0) < 0){
-        if (errno == EWOULDBLOCK)
-            std::cout << "buffer is full, keep trying\n";
-    }
+// queue the header, the body follows it in the queue
+// without a Content-Length the end of the body can only be told by closing the connection
+void Httpd_handler::send_status200(long content_length) {
+    if (content_length < 0)
+        keep_alive_ = false;
+    send_head(STATUS_ID_200, content_length);
+}
+
+// error responses are constant but for the header tail, so a flood of them costs a copy of it each
+void Httpd_handler::send_error(Status_id status) {
+    skip_body();
+    const Http_status& entry = http_status(status);
+    send_head(status, entry.page.len);
+    out_.append_static(entry.page.data, entry.page.len);
+}
+
+void Httpd_handler::send_error400() {
+    // the rest of in_buf_ can't be trusted after a malformed request
+    keep_alive_ = false;
+    send_error(STATUS_ID_400);
+}
+
+void Httpd_handler::send_error413() {
+    keep_alive_ = false;
+    send_error(STATUS_ID_413);
+}
+
+void Httpd_handler::send_error404() {
+    send_error(STATUS_ID_404);
 }
 
-// This function will return needed info of the object
-std::string Httpd_handler::get_base_info() {
-    std::string info = url_ + "," + method_;
-    return info;
+void Httpd_handler::send_error500() {
+    keep_alive_ = false;
+    send_error(STATUS_ID_500);
 }
 
-// This function will set needed info for the object
-void Httpd_handler::set_base_info(const std::string& buffer_str) {
-    int split_index = buffer_str.find(',', 0);
-    url_ = buffer_str.substr(0, split_index),
-    method_ = buffer_str.substr(split_index + 1, buffer_str.size() - split_index - 1);
+void Httpd_handler::send_error501() {
+    send_error(STATUS_ID_501);
+}
+
+void Httpd_handler::send_error502() {
+    send_error(STATUS_ID_502);
+}
+
+void Httpd_handler::send_error503() {
+    send_error(STATUS_ID_503);
+}
+
+void Httpd_handler::send_error504() {
+    send_error(STATUS_ID_504);
+}
+
+// the metrics of all threads in the Prometheus text format, built on demand, the page is never cached
+void Httpd_handler::send_stats() {
+    std::string stats = Metrics::prometheus();
+    set_status(200);
+    Slice head = http_status(STATUS_ID_200).head;
+    out_.append_static(head.data, head.len);
+    static const char content_type[] = "Content-Type: text/plain; version=0.0.4\r\n";
+    out_.append_static(content_type, LITERAL_LEN(content_type));
+    append_header_tail(false, stats.size());
+    out_.append(stats.data(), stats.size());
 }
 
 // serve default index.html to user
+// small files are served from File_cache with no filesystem access, the queue shares the cached bytes
+// other files are queued as sendfile ranges, so binary files arrive intact and the CPU cost doesn't grow with the file
 void Httpd_handler::serve_file() {
-    std::string buffer;
-    if (url_ == "/")
-        url_ += "index.html";
-    path_ += url_;
+    skip_body();
+    if (url_.equals(STATS_PATH)){
+        send_stats();
+        return;
+    }
+    if (url_.equals("/"))
+        url_ = Slice{"/index.html", 11};
+    // path_ keeps its capacity across requests, so building it doesn't allocate
+    path_.assign(HTDOCS_PATH).append(url_.data, url_.len);
+
+    File_cache& cache = File_cache::instance();
+    std::shared_ptr<const File_cache::Entry> entry = cache.get(path_);
+    if (entry != nullptr){
+        send_cached(entry);
+        return;
+    }
 
     // open html
-    std::ifstream file(path_);
-    if (!file.is_open()){
+    int file_fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file_fd == -1){
+        send_error404();
+        return;
+    }
+    // only regular files can be served, directories and devices are treated as missing
+    struct stat file_stat{};
+    if (fstat(file_fd, &file_stat) == -1 || !S_ISREG(file_stat.st_mode)){
+        close(file_fd);
         send_error404();
         return;
     }
 
-    // send header
-    send_status200();
-
-    // send body
-    while (std::getline(file,  buffer)){
-#ifdef DEBUG
-        std::cout << "sending: " << buffer.c_str() << std::endl;
-#endif
-        // send based on non-block socket
-        while (send(client_fd_, buffer.c_str(), strlen(buffer.c_str()), 0) < 0){
-            if (errno == EWOULDBLOCK)
-                std::cout << "buffer is full, keep trying";
+    // read small files into the cache, the watch has to be in place before reading
+    uint64_t generation = 0;
+    if (cache.cacheable(file_stat.st_size))
+        generation = cache.watch(path_);
+    if (generation != 0){
+        std::shared_ptr<File_cache::Entry> fill = std::make_shared<File_cache::Entry>();
+        fill->body.resize(file_stat.st_size);
+        ssize_t num_read = pread(file_fd, &fill->body[0], fill->body.size(), 0);
+        if (num_read >= 0){
+            close(file_fd);
+            fill->body.resize(num_read);
+            // Date and Connection change, they are added to every response sent from the entry
+            fill->header.assign(STATUS_200 SERVER_STRING "Content-Type: text/html\r\nContent-Length: ")
+                    .append(std::to_string(num_read)).append("\r\n");
+            cache.put(path_, fill, generation);
+            send_cached(fill);
+            return;
         }
     }
-    std::cout << "sending complete\n";
-    file.close();
+
+    // send header
+    send_status200(file_stat.st_size);
+
+    // send body, the queue closes file_fd once it is sent
+    out_.append_file(file_fd, 0, file_stat.st_size);
+}
+
+// queue a cached response, header and body stay in the cache entry, which lives until they are sent
+void Httpd_handler::send_cached(const std::shared_ptr<const File_cache::Entry>& entry) {
+    set_status(200);
+    out_.append(std::shared_ptr<const std::string>(entry, &entry->header));
+    append_header_tail(false, -1);
+    out_.append(std::shared_ptr<const std::string>(entry, &entry->body));
 }
 
-// execute cgi and transfer the execution result to the user
-// we fork a child process to execute cgi
-// the parent process is in charge of transferring the execution result
+// execute cgi and relay the execution result to the user
+// we fork a child process to execute cgi, the worker thread stays in the server
+// the child's stdout and stdin are non-blocking pipes, Httpd watches them with epoll and calls relay_cgi(),
+// which passes the request body on as it arrives and relays the output
+// the request stays current until the child is done, so its slices are still valid for the response
 void Httpd_handler::execute_cgi() {
-    char temp;
     pid_t pid;
-    int status;
     int pipe_to_parent[2];
+    int pipe_to_child[2];
 
-    if (url_ == "/")
-        url_ += "test.cgi";
-    path_ += url_;
+    if (url_.equals("/"))
+        url_ = Slice{"/test.cgi", 9};
+    path_.assign(HTDOCS_PATH).append(url_.data, url_.len);
 
     std::ifstream file(path_);
     if (!file.is_open()){
@@ -348,73 +686,615 @@ void Httpd_handler::execute_cgi() {
         return;
     }
 
-    // send header
-    send_status200();
+    // persistent FastCGI workers answer .fcgi scripts, Httpd finds one and calls start_fcgi()
+    if (url_.len > 5 && memcmp(url_.data + url_.len - 5, ".fcgi", 5) == 0 && Fcgi_pool::instance().enabled()){
+        fcgi_wait_ = true;
+        return;
+    }
 
-    // create one-way channel
-    if ((pipe(pipe_to_parent)) == -1){
+    // create one-way channels, one for the output and one for the body
+    // close-on-exec, so CGI children forked by other workers don't hold our ends open
+    if ((pipe2(pipe_to_parent, O_CLOEXEC)) == -1){
+        send_error500();
+        return;
+    }
+    if ((pipe2(pipe_to_child, O_CLOEXEC)) == -1){
+        close(pipe_to_parent[0]);
+        close(pipe_to_parent[1]);
         send_error500();
         return;
     }
 
+    // create environment variable for cgi before fork
+    // the child of a multi-threaded process may only call async-signal-safe functions
+    // a chunked body has no length, the script reads its stdin to the end
+    Slice connection = parser_.header(HEADER_CONNECTION);
+    Slice content_type = parser_.header(HEADER_CONTENT_TYPE);
+    char* envp[] = {
+            arena_.format("URL=%.*s", (int) url_.len, url_.data),
+            arena_.format("REQUEST_VERSION=%.*s", (int) ver_.len, ver_.data),
+            arena_.format("REQUEST_METHOD=%.*s", (int) method_.len, method_.data),
+            arena_.format("CONNECTION=%.*s", (int) connection.len, connection.data),
+            arena_.format("CONTENT_TYPE=%.*s", (int) content_type.len, content_type.data),
+            get_content_length() >= 0 ? arena_.format("CONTENT_LENGTH=%ld", get_content_length()) : nullptr,
+            nullptr};
+
     // fork to have 2 processes
+    uint64_t spawn_start = Metrics::now_ns();
     if ((pid = fork()) < 0){
+        close(pipe_to_parent[0]);
+        close(pipe_to_parent[1]);
+        close(pipe_to_child[0]);
+        close(pipe_to_child[1]);
         send_error500();
         return;
     }
 
     // child process, execute cgi
     if (pid == 0){
-        std::cout << "child process executing cgi\n";
-        // close read end
-        close(pipe_to_parent[0]);
         // redirect STDOUT to pipe, so the execution result can transfer to parent process
         dup2(pipe_to_parent[1], STDOUT);
-        // create environment variable for cgi
-        char url_env[255];
-        sprintf(url_env, "URL=%s", url_.c_str());
-        putenv(url_env);
-        char version_env[255];
-        sprintf(version_env, "REQUEST_VERSION=%s", ver_.c_str());
-        putenv(version_env);
-        char method_env[255];
-        sprintf(method_env, "REQUEST_METHOD=%s", method_.c_str());
-        putenv(method_env);
-        char connection_env[255];
-        sprintf(connection_env, "CONNECTION=%s", header_.find("Connection")->second.c_str());
-        putenv(connection_env);
+        // and STDIN, the body comes from the parent process
+        dup2(pipe_to_child[0], STDIN);
         // execute cgi
-        execl(path_.c_str(), NULL);
-        close(pipe_to_parent[1]);
-        // after execution, the child process will exit
-        exit(0);
+        execle(path_.c_str(), path_.c_str(), (char*) nullptr, envp);
+        // only reached when exec failed
+        _exit(1);
     }
-    // parent process
-    else if (pid > 0){
-        printf("creat child process %d\n", pid);
-        // close write end
-        close(pipe_to_parent[1]);
-        // read cgi execution result from pipe
-        // WE HAVE TO READ RESULT FROM PIPE ONE BY ONE
-        while (read(pipe_to_parent[0], &temp, sizeof(temp)) > 0){
-            // send the result to the client
-            while (send(client_fd_, &temp, sizeof(temp), 0) < 0){
-                if (errno == EWOULDBLOCK)
-                    std::cout << "waiting for socket buffer to clear\n";
-            }
+    // parent process, keep the read end for relay_cgi() and the write end for feed_cgi()
+    Metrics::record(HISTOGRAM_CGI_SPAWN, Metrics::now_ns() - spawn_start);
+    Metrics::count(COUNTER_CGI_SPAWNED);
+    LOG(LOG_DEBUG, "creat child process %d", pid);
+    close(pipe_to_parent[1]);
+    close(pipe_to_child[0]);
+    fcntl(pipe_to_parent[0], F_SETFL, O_NONBLOCK);
+    fcntl(pipe_to_child[1], F_SETFL, O_NONBLOCK);
+    cgi_pid_ = pid;
+    start_cgi_io(pipe_to_parent[0], pipe_to_child[1]);
+}
+
+bool Httpd_handler::fcgi_waiting() const {
+    return fcgi_wait_;
+}
+
+const std::string& Httpd_handler::get_path() const {
+    return path_;
+}
+
+// send the request to worker, the same variables as the environment of a CGI child
+// the body follows as FCGI_STDIN records from feed_cgi()
+// worker is nullptr when none could be had, the client is told to come back later
+void Httpd_handler::start_fcgi(Fcgi_worker* worker) {
+    fcgi_wait_ = false;
+    if (worker == nullptr){
+        send_error503();
+        return;
+    }
+    unsigned char begin[8] = {0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0};
+    std::string params;
+    Slice connection = parser_.header(HEADER_CONNECTION);
+    Slice content_type = parser_.header(HEADER_CONTENT_TYPE);
+    fcgi_param(params, "SCRIPT_FILENAME", path_.data(), path_.size());
+    fcgi_param(params, "URL", url_.data, url_.len);
+    fcgi_param(params, "REQUEST_VERSION", ver_.data, ver_.len);
+    fcgi_param(params, "REQUEST_METHOD", method_.data, method_.len);
+    fcgi_param(params, "CONNECTION", connection.data, connection.len);
+    fcgi_param(params, "CONTENT_TYPE", content_type.data, content_type.len);
+    if (get_content_length() >= 0){
+        const char* content_length = arena_.format("%ld", get_content_length());
+        fcgi_param(params, "CONTENT_LENGTH", content_length, strlen(content_length));
+    }
+    std::string records;
+    fcgi_record(records, FCGI_BEGIN_REQUEST, (const char*) begin, sizeof(begin));
+    fcgi_record(records, FCGI_PARAMS, params.data(), params.size());
+    fcgi_record(records, FCGI_PARAMS, nullptr, 0);
+    // these records are far smaller than the socket buffer, they are sent blocking
+    // the body may not be, feed_cgi() sends it without blocking
+    const char* p = records.data();
+    size_t left = records.size();
+    while (left > 0){
+        ssize_t num_sent = send(worker->fd, p, left, MSG_NOSIGNAL);
+        if (num_sent < 0 && errno == EINTR)
+            continue;
+        if (num_sent <= 0){
+            Fcgi_pool::instance().release(worker, false);
+            send_error502();
+            return;
         }
-        // wait for the child to exit
-        waitpid(pid, &status, 0);
-        if (WEXITSTATUS(status) == 0){
-            std::cout << "child process exit normally\n\n";
-        }else
-            std::cout << "child process exit abnormally, exit signal code:" << WSTOPSIG(status) << "\n\n";
-        close(pipe_to_parent[0]);
+        p += num_sent;
+        left -= num_sent;
     }
+    fcgi_worker_ = worker;
+    start_cgi_io(worker->fd, -1);
+}
+
+Timer* Httpd_handler::fcgi_timer() {
+    return fcgi_worker_ == nullptr ? nullptr : &fcgi_worker_->timer;
+}
+
+bool Httpd_handler::cgi_running() const {
+    return cgi_fd_ != -1;
+}
+
+int Httpd_handler::get_cgi_epoll() const {
+    return cgi_epoll_;
 }
 
+// the CGI has started, its output comes from out_fd, and its body goes to in_fd, or in records to a FastCGI worker
+// a client that waits for 100 Continue before sending the body gets it now
+void Httpd_handler::start_cgi_io(int out_fd, int in_fd) {
+    cgi_fd_ = out_fd;
+    cgi_in_fd_ = in_fd;
+    cgi_in_open_ = true;
+    cgi_epoll_ = epoll_create1(EPOLL_CLOEXEC);
+    if (cgi_epoll_ == -1){
+        abort_cgi(500);
+        return;
+    }
+    if (body_.state() == Body_reader::BODY && body_pos_ == in_end_ && ver_.equals("HTTP/1.1") &&
+            parser_.header(HEADER_EXPECT).equals_nocase("100-continue"))
+        out_.append_static(STATUS_100, LITERAL_LEN(STATUS_100));
+}
 
+// pass the body from the client to the child, as far as both of them go along
+// whatever is received is written to the child before more is received, so the child reading slowly
+// slows down the client, and at most BODY_BUF_SIZE of the body is held here
+// return true if anything was passed on
+bool Httpd_handler::feed_cgi() {
+    bool fed = false;
+    cgi_in_blocked_ = false;
+    // the last record to a worker goes first, it can't be mixed with the next one
+    if (!fcgi_out_.empty()){
+        int result = flush_fcgi_out();
+        if (result < 0){
+            cgi_in_open_ = false;
+            fcgi_out_.clear();
+        }
+        else if (result == 0){
+            cgi_in_blocked_ = true;
+            return false;
+        }
+    }
+    while (cgi_in_open_){
+        if (body_.state() == Body_reader::DONE){
+            end_cgi_stdin();
+            fed = true;
+            break;
+        }
+        size_t data_len;
+        body_pos_ += body_.next(in_buf_ + body_pos_, in_end_ - body_pos_, data_len);
+        if (body_.state() == Body_reader::ERROR){
+            abort_cgi(400);
+            break;
+        }
+        if (data_len == 0){
+            if (body_.state() == Body_reader::DONE)
+                continue;
+            int result = receive_body();
+            if (result < 0)
+                abort_cgi(0);
+            if (result <= 0)
+                break;
+            fed = true;
+            continue;
+        }
+        // a chunked body has no length up front, it is checked as it comes
+        if (body_.received() + data_len > (uint64_t) max_body_){
+            abort_cgi(413);
+            break;
+        }
+        ssize_t num_written = write_cgi_stdin(in_buf_ + body_pos_, data_len);
+        // the child stopped reading, the rest of the body is left to finish_request()
+        if (num_written < 0){
+            end_cgi_stdin();
+            break;
+        }
+        if (num_written == 0){
+            cgi_in_blocked_ = true;
+            break;
+        }
+        body_.consume(num_written);
+        body_pos_ += num_written;
+        fed = true;
+    }
+    return fed;
+}
 
+// return the bytes taken, 0 if the pipe or the worker's socket is full, -1 if the child is gone
+ssize_t Httpd_handler::write_cgi_stdin(const char* data, size_t len) {
+    if (fcgi_worker_ == nullptr){
+        ssize_t num_written;
+        while ((num_written = write(cgi_in_fd_, data, len)) < 0 && errno == EINTR);
+        if (num_written < 0)
+            return errno == EAGAIN ? 0 : -1;
+        return num_written;
+    }
+    if (!fcgi_out_.empty())
+        return 0;
+    fcgi_record(fcgi_out_, FCGI_STDIN, data, len);
+    if (flush_fcgi_out() < 0)
+        return -1;
+    return (ssize_t) len;
+}
 
+// send what is left of the records in fcgi_out_
+// return 1 if all of it is sent, 0 if the worker's socket is full, -1 if the worker is gone
+int Httpd_handler::flush_fcgi_out() {
+    while (!fcgi_out_.empty()){
+        ssize_t num_sent = send(cgi_fd_, fcgi_out_.data(), fcgi_out_.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (num_sent < 0 && errno == EINTR)
+            continue;
+        if (num_sent < 0 && errno == EAGAIN)
+            return 0;
+        if (num_sent <= 0)
+            return -1;
+        fcgi_out_.erase(0, num_sent);
+    }
+    return 1;
+}
 
+// the child gets the end of its stdin, an empty FCGI_STDIN record for a worker
+void Httpd_handler::end_cgi_stdin() {
+    cgi_in_open_ = false;
+    if (fcgi_worker_ != nullptr){
+        fcgi_record(fcgi_out_, FCGI_STDIN, nullptr, 0);
+        if (flush_fcgi_out() < 0)
+            fcgi_out_.clear();
+        return;
+    }
+    if (cgi_in_fd_ != -1){
+        watch(cgi_in_fd_, watch_in_, 0);
+        close(cgi_in_fd_);
+        cgi_in_fd_ = -1;
+    }
+}
 
+// a broken or oversized body, or a client gone in the middle of it, stops the CGI
+// the client gets status if the CGI hasn't answered yet, 0 when it is gone
+void Httpd_handler::abort_cgi(int status) {
+    cgi_in_open_ = false;
+    cgi_abort_ = true;
+    keep_alive_ = false;
+    if (cgi_head_done_ || status == 0)
+        return;
+    cgi_head_done_ = true;
+    if (status == 413)
+        send_error413();
+    else if (status == 400)
+        send_error400();
+    else
+        send_error500();
+}
+
+// add, change or remove fd in cgi_epoll_, current is what it is watched for now
+void Httpd_handler::watch(int fd, uint32_t& current, uint32_t events) {
+    if (events == current)
+        return;
+    struct epoll_event event{};
+    event.data.fd = fd;
+    event.events = events;
+    epoll_ctl(cgi_epoll_, current == 0 ? EPOLL_CTL_ADD : events == 0 ? EPOLL_CTL_DEL : EPOLL_CTL_MOD, fd, &event);
+    current = events;
+}
+
+// set up what the CGI waits for, all level-triggered in cgi_epoll_:
+// its output while the queue has room, room in its stdin for the body bytes it didn't take,
+// more of the body once everything received is passed on, and the client reading when output_blocked
+// return whether the client is watched, Httpd times it
+bool Httpd_handler::watch_cgi(bool output_blocked) {
+    uint32_t output = out_.full() ? 0 : EPOLLIN;
+    uint32_t input = cgi_in_blocked_ ? EPOLLOUT : 0;
+    if (fcgi_worker_ != nullptr)
+        watch(cgi_fd_, watch_out_, output | input);
+    else{
+        watch(cgi_fd_, watch_out_, output);
+        if (cgi_in_fd_ != -1)
+            watch(cgi_in_fd_, watch_in_, input);
+    }
+    uint32_t client = output_blocked ? EPOLLOUT : 0;
+    if (cgi_in_open_ && !cgi_in_blocked_ && body_.state() == Body_reader::BODY)
+        client |= EPOLLIN;
+    watch(client_fd_, watch_client_, client);
+    return client != 0;
+}
+
+// feed the child its body, then move what it has written so far to the output queue
+// CGI_MORE: something was passed on or queued, flush it and call again
+// CGI_WAIT: nothing can move, wait for what watch_cgi() sets up
+// CGI_DONE: the child closed its output and the response is complete, or the CGI was aborted, call finish_cgi()
+Httpd_handler::Cgi_state Httpd_handler::relay_cgi() {
+    bool fed = feed_cgi();
+    if (cgi_abort_)
+        return CGI_DONE;
+    // a full queue waits for the client before more output is read
+    Cgi_state state = CGI_WAIT;
+    if (!out_.full())
+        state = fcgi_worker_ != nullptr ? relay_fcgi() : relay_pipe();
+    if (state == CGI_WAIT && fed)
+        return CGI_MORE;
+    return state;
+}
+
+// The output part of relay_cgi() for a CGI child, nothing more is read from the pipe before CGI_MORE is flushed
+Httpd_handler::Cgi_state Httpd_handler::relay_pipe() {
+    char buf[MAX_BUF_SIZE];
+    // the child's header block is read and copied, it has to be looked at
+    while (!cgi_head_done_){
+        ssize_t num_read = read(cgi_fd_, buf, sizeof(buf));
+        if (num_read < 0){
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN)
+                return CGI_WAIT;
+        }
+        if (num_read <= 0){
+            end_cgi_output();
+            return CGI_DONE;
+        }
+        cgi_output(buf, num_read);
+        if (cgi_head_done_)
+            return CGI_MORE;
+    }
+    // the body is spliced from the pipe to the socket, only what is in the pipe right now
+    int available = 0;
+    if (ioctl(cgi_fd_, FIONREAD, &available) == 0 && available > 0){
+        if (cgi_chunked_)
+            out_.append(buf, snprintf(buf, sizeof(buf), "%x\r\n", available));
+        out_.append_pipe(cgi_fd_, available);
+        if (cgi_chunked_)
+            out_.append("\r\n", 2);
+        return CGI_MORE;
+    }
+    // an empty pipe is either waiting for the child or at its end, a read tells which
+    ssize_t num_read;
+    while ((num_read = read(cgi_fd_, buf, sizeof(buf))) < 0 && errno == EINTR);
+    if (num_read > 0){
+        send_cgi_body(buf, num_read);
+        return CGI_MORE;
+    }
+    if (num_read < 0 && errno == EAGAIN)
+        return CGI_WAIT;
+    end_cgi_output();
+    return CGI_DONE;
+}
+
+// The same as relay_pipe() for a FastCGI worker, whose output comes framed in records
+// FCGI_STDOUT content is the CGI output, FCGI_END_REQUEST ends it and leaves the worker ready for the next request
+Httpd_handler::Cgi_state Httpd_handler::relay_fcgi() {
+    char buf[MAX_BUF_SIZE * 16];
+    ssize_t num_read = recv(cgi_fd_, buf, sizeof(buf), MSG_DONTWAIT);
+    if (num_read < 0 && errno == EINTR)
+        return CGI_MORE;
+    if (num_read < 0 && errno == EAGAIN)
+        return CGI_WAIT;
+    // the worker died, or its time ran out and the connection was shut down
+    if (num_read <= 0){
+        if (!cgi_head_done_){
+            cgi_head_done_ = true;
+            if (Timer_wheel::now() >= fcgi_worker_->timer.expire)
+                send_error504();
+            else
+                send_error502();
+        }
+        else{
+            // the client can't tell a cut body from a complete one, closing tells it
+            keep_alive_ = false;
+        }
+        return CGI_DONE;
+    }
+    fcgi_in_.append(buf, num_read);
+    size_t pos = 0;
+    while (fcgi_in_.size() - pos >= FCGI_HEADER_LEN){
+        const unsigned char* header = (const unsigned char*) fcgi_in_.data() + pos;
+        size_t content_len = (header[4] << 8) | header[5];
+        size_t record_len = FCGI_HEADER_LEN + content_len + header[6];
+        if (fcgi_in_.size() - pos < record_len)
+            break;
+        const char* content = fcgi_in_.data() + pos + FCGI_HEADER_LEN;
+        pos += record_len;
+        if (header[1] == FCGI_STDOUT)
+            cgi_output(content, content_len);
+        else if (header[1] == FCGI_STDERR)
+            LOG(LOG_WARN, "fcgi stderr of %s: %.*s", path_.c_str(), (int) content_len, content);
+        else if (header[1] == FCGI_END_REQUEST){
+            fcgi_ended_ = true;
+            end_cgi_output();
+            fcgi_in_.clear();
+            return CGI_DONE;
+        }
+    }
+    fcgi_in_.erase(0, pos);
+    return CGI_MORE;
+}
+
+// CGI output goes to the header block until it is complete, then to the body
+void Httpd_handler::cgi_output(const char* data, size_t len) {
+    if (cgi_head_done_){
+        send_cgi_body(data, len);
+        return;
+    }
+    cgi_head_.append(data, len);
+    send_cgi_head(true);
+}
+
+// output ended, before a complete header block whatever came is the body
+void Httpd_handler::end_cgi_output() {
+    if (!cgi_head_done_)
+        send_cgi_head(false);
+    else if (cgi_chunked_)
+        out_.append("0\r\n\r\n", 5);
+}
+
+// A CGI script may start its output with a header block, like "Content-Type: text/html" and a blank line
+// Status sets the status line, Location without Status is a redirect, Content-Length is passed on,
+// and without it the body is sent chunked to HTTP/1.1 clients, so the connection can be kept
+// Output that doesn't start with a header line has no header block, all of it is the body
+// more is false at the end of the output, when what has arrived is all there is
+void Httpd_handler::send_cgi_head(bool more) {
+    const char* head = cgi_head_.data();
+    const char* end = head + cgi_head_.size();
+    const char* body = nullptr;
+    const char* first_lf = find_char(head, end, '\n');
+    const char* colon = find_char(head, first_lf, ':');
+    bool has_head = colon != first_lf && colon != head;
+    for (const char* p = head; has_head && p < colon; p++){
+        if (*p == ' ' || *p == '\t')
+            has_head = false;
+    }
+    if (has_head){
+        // the header block ends with an empty line
+        for (const char* p = first_lf; p < end; p = find_char(p + 1, end, '\n')){
+            if (p + 1 < end && p[1] == '\n'){
+                body = p + 2;
+                break;
+            }
+            if (p + 2 < end && p[1] == '\r' && p[2] == '\n'){
+                body = p + 3;
+                break;
+            }
+        }
+    }
+    // wait for the first line, or the end of the header block, unless there is no more output
+    if (more && ((first_lf == end && cgi_head_.size() < MAX_REQUEST_SIZE) ||
+                     (has_head && body == nullptr && cgi_head_.size() < MAX_REQUEST_SIZE)))
+        return;
+    if (body == nullptr){
+        has_head = false;
+        body = head;
+    }
+    cgi_head_done_ = true;
+
+    // an exec failure or a crash before any output is the server's error, not an empty page
+    if (!more && cgi_head_.empty() && cgi_pid_ > 0){
+        int status = 0;
+        waitpid(cgi_pid_, &status, 0);
+        cgi_pid_ = -1;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0){
+            send_error500();
+            return;
+        }
+    }
+
+    // the status line comes from the table unless the script sets its own
+    Slice status_line = http_status(STATUS_ID_200).head;
+    int code = 200;
+    bool own_status = false;
+    bool content_type = false;
+    bool content_length = false;
+    std::string header;
+    if (has_head){
+        const char* p = head;
+        while (p < body){
+            const char* lf = find_char(p, body, '\n');
+            const char* line_end = lf;
+            if (line_end > p && line_end[-1] == '\r')
+                line_end--;
+            const char* sep = find_char(p, line_end, ':');
+            if (sep != line_end){
+                Slice name{p, (size_t) (sep - p)};
+                const char* value = sep + 1;
+                while (value < line_end && (*value == ' ' || *value == '\t'))
+                    value++;
+                if (name.equals_nocase("Status")){
+                    char* line = arena_.format("HTTP/1.1 %.*s\r\n" SERVER_STRING, (int) (line_end - value), value);
+                    status_line = Slice{line, strlen(line)};
+                    own_status = true;
+                    code = atoi(value);
+                }
+                // the server sends its own Date
+                else if (!name.equals_nocase("Connection") && !name.equals_nocase("Transfer-Encoding") &&
+                         !name.equals_nocase("Date")){
+                    if (name.equals_nocase("Location") && !own_status){
+                        status_line = http_status(STATUS_ID_302).head;
+                        code = 302;
+                    }
+                    content_type |= name.equals_nocase("Content-Type");
+                    content_length |= name.equals_nocase("Content-Length");
+                    header.append(p, line_end - p).append("\r\n");
+                }
+            }
+            p = lf + 1;
+        }
+    }
+
+    // a body whose length is known now, or given by the script, can keep the connection
+    // otherwise HTTP/1.1 gets chunks, and anything else can only be ended by closing
+    long length = -1;
+    if (!more && !content_length){
+        length = end - body;
+        content_length = true;
+    }
+    cgi_chunked_ = false;
+    if (!content_length){
+        if (ver_.equals("HTTP/1.1")){
+            cgi_chunked_ = true;
+            header.append("Transfer-Encoding: chunked\r\n");
+        }
+        else
+            keep_alive_ = false;
+    }
+    set_status(code);
+    if (own_status)
+        out_.append(status_line.data, status_line.len);
+    else
+        out_.append_static(status_line.data, status_line.len);
+    out_.append(header.data(), header.size());
+    append_header_tail(!content_type, length);
+    send_cgi_body(body, end - body);
+}
+
+// queue body bytes of the CGI response, framed as a chunk if the response is chunked
+void Httpd_handler::send_cgi_body(const char* data, size_t len) {
+    if (len == 0)
+        return;
+    if (cgi_chunked_){
+        char size_line[32];
+        out_.append(size_line, snprintf(size_line, sizeof(size_line), "%zx\r\n", len));
+    }
+    out_.append(data, len);
+    if (cgi_chunked_)
+        out_.append("\r\n", 2);
+}
+
+// the child's output is all queued, close the pipe and reap the child
+// kill_child stops a child whose client has gone away
+// a FastCGI worker goes back to the pool instead, unless it is in the middle of a request
+void Httpd_handler::finish_cgi(bool kill_child) {
+    if (cgi_fd_ == -1)
+        return;
+    kill_child |= cgi_abort_;
+    // closing the epoll fd drops everything it watches
+    if (cgi_epoll_ != -1)
+        close(cgi_epoll_);
+    cgi_epoll_ = -1;
+    watch_out_ = watch_in_ = watch_client_ = 0;
+    if (cgi_in_fd_ != -1)
+        close(cgi_in_fd_);
+    cgi_in_fd_ = -1;
+    cgi_in_open_ = cgi_in_blocked_ = cgi_abort_ = false;
+    if (fcgi_worker_ != nullptr){
+        // a record cut in the middle would garble the worker's next request
+        Fcgi_pool::instance().release(fcgi_worker_, fcgi_ended_ && !kill_child && fcgi_out_.empty());
+        fcgi_worker_ = nullptr;
+        fcgi_ended_ = false;
+        fcgi_in_.clear();
+        fcgi_out_.clear();
+    }
+    else
+        close(cgi_fd_);
+    cgi_fd_ = -1;
+    if (cgi_pid_ > 0){
+        int status;
+        if (kill_child)
+            kill(cgi_pid_, SIGKILL);
+        waitpid(cgi_pid_, &status, 0);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+            LOG(LOG_DEBUG, "child process exit normally");
+        else
+            LOG(kill_child ? LOG_DEBUG : LOG_WARN, "child process exit abnormally, exit signal code:%d", WTERMSIG(status));
+    }
+    cgi_pid_ = -1;
+    cgi_head_.clear();
+    cgi_head_done_ = false;
+    cgi_chunked_ = false;
+}
@@ -0,0 +1,246 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include "io_uring.h"
+
+#ifdef HTTPD_IO_URING
+
+#include <linux/io_uring.h>
+
+bool Uring_event::more() const {
+    return flags & IORING_CQE_F_MORE;
+}
+
+bool Uring_event::has_buffer() const {
+    return flags & IORING_CQE_F_BUFFER;
+}
+
+uint16_t Uring_event::buffer_id() const {
+    return (uint16_t) (flags >> IORING_CQE_BUFFER_SHIFT);
+}
+
+Io_uring::Io_uring() : ring_fd_(-1), sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(0), sq_entries_(0),
+                       sqes_(nullptr), cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(0), cqes_(nullptr),
+                       ring_ptr_(nullptr), ring_size_(0), sqes_size_(0), bufs_(nullptr) {}
+
+Io_uring::~Io_uring() {
+    if (ring_fd_ >= 0)
+        close(ring_fd_);
+    if (ring_ptr_ != nullptr)
+        munmap(ring_ptr_, ring_size_);
+    if (sqes_ != nullptr)
+        munmap(sqes_, sqes_size_);
+    delete[] bufs_;
+}
+
+bool Io_uring::set_up() {
+    struct io_uring_params params{};
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_ENTRIES * 4;
+    ring_fd_ = (int) syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring_fd_ < 0)
+        return false;
+    // both rings in one mapping, and completions kept by the kernel rather than dropped when the queue is full
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP))
+        return false;
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    ring_size_ = sq_size > cq_size ? sq_size : cq_size;
+    void* ring = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                      IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED)
+        return false;
+    ring_ptr_ = ring;
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+        return false;
+    sqes_ = (io_uring_sqe*) sqes;
+
+    char* base = (char*) ring;
+    sq_head_ = (unsigned*) (base + params.sq_off.head);
+    sq_tail_ = (unsigned*) (base + params.sq_off.tail);
+    sq_mask_ = *(unsigned*) (base + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    // entry i of the queue is always sqes_[i], the indirection array is filled once
+    unsigned* array = (unsigned*) (base + params.sq_off.array);
+    for (unsigned i = 0; i < sq_entries_; i++)
+        array[i] = i;
+    cq_head_ = (unsigned*) (base + params.cq_off.head);
+    cq_tail_ = (unsigned*) (base + params.cq_off.tail);
+    cq_mask_ = *(unsigned*) (base + params.cq_off.ring_mask);
+    cqes_ = (io_uring_cqe*) (base + params.cq_off.cqes);
+
+    // all buffers are provided at once, and the completion of that is waited for, which tells whether the kernel
+    // takes the requests used here at all
+    bufs_ = new char[(size_t) URING_BUF_NUMS * URING_BUF_SIZE];
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = URING_BUF_NUMS;
+    sqe->addr = (uint64_t) (uintptr_t) bufs_;
+    sqe->len = URING_BUF_SIZE;
+    sqe->buf_group = URING_BUF_GROUP;
+    put_sqe();
+    Uring_event event{};
+    if (enter(1, 1, IORING_ENTER_GETEVENTS) < 0 || wait(&event, 1) != 1 || event.res < 0)
+        return false;
+    return true;
+}
+
+int Io_uring::enter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    int ret;
+    while ((ret = (int) syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, nullptr, 0)) < 0
+           && errno == EINTR);
+    return ret;
+}
+
+// sq_mutex_ is held, a full queue is handed to the kernel first
+// the loop thread submits whatever it queued with every wait(), so the queue only fills up under a burst
+io_uring_sqe* Io_uring::get_sqe() {
+    unsigned tail = *sq_tail_;
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == sq_entries_)
+        enter(sq_entries_, 0, 0);
+    io_uring_sqe* sqe = &sqes_[tail & sq_mask_];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// publish the entry from get_sqe(), a thread other than the waiting one submits it right away,
+// nothing else would wake the loop for it
+void Io_uring::put_sqe() {
+    __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+}
+
+void Io_uring::bind_thread() {
+    owner_ = std::this_thread::get_id();
+}
+
+void Io_uring::accept_multishot(int listen_fd, uint64_t user_data) {
+    {
+        std::lock_guard<std::mutex> lock(sq_mutex_);
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+        sqe->user_data = user_data;
+        put_sqe();
+    }
+    if (std::this_thread::get_id() != owner_)
+        submit();
+}
+
+void Io_uring::poll(int fd, uint32_t events, uint64_t user_data, bool multishot) {
+    {
+        std::lock_guard<std::mutex> lock(sq_mutex_);
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = events;
+        sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+        sqe->user_data = user_data;
+        put_sqe();
+    }
+    if (std::this_thread::get_id() != owner_)
+        submit();
+}
+
+void Io_uring::recv(int fd, uint64_t user_data) {
+    {
+        std::lock_guard<std::mutex> lock(sq_mutex_);
+        io_uring_sqe* sqe = get_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        // no address and length, the kernel takes a whole buffer of the group once there is data
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUF_GROUP;
+        sqe->user_data = user_data;
+        put_sqe();
+    }
+    if (std::this_thread::get_id() != owner_)
+        submit();
+}
+
+void Io_uring::submit() {
+    if (enter(sq_entries_, 0, 0) < 0)
+        perror("ERROR: io_uring submit failed\n");
+}
+
+// block only when there is no completion yet, entries queued since the last call are submitted either way
+int Io_uring::wait(Uring_event* events, int max) {
+    unsigned head = *cq_head_;
+    bool empty = head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    bool queued = *sq_tail_ != __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (empty || queued){
+        if (enter(sq_entries_, empty ? 1 : 0, empty ? IORING_ENTER_GETEVENTS : 0) < 0)
+            perror("ERROR: io_uring wait failed\n");
+    }
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    int nums = 0;
+    while (head != tail && nums < max){
+        io_uring_cqe* cqe = &cqes_[head & cq_mask_];
+        events[nums++] = Uring_event{cqe->user_data, cqe->res, cqe->flags};
+        head++;
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    return nums;
+}
+
+// one buffer provided again, its completion is skipped unless it fails
+void Io_uring::recycle(uint16_t id) {
+    std::lock_guard<std::mutex> lock(sq_mutex_);
+    io_uring_sqe* sqe = get_sqe();
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = 1;
+    sqe->addr = (uint64_t) (uintptr_t) buffer(id);
+    sqe->len = URING_BUF_SIZE;
+    sqe->off = id;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    put_sqe();
+}
+
+#else
+
+// built without io_uring, set_up() fails and nothing else is ever called
+
+bool Uring_event::more() const { return false; }
+
+bool Uring_event::has_buffer() const { return false; }
+
+uint16_t Uring_event::buffer_id() const { return 0; }
+
+Io_uring::Io_uring() : ring_fd_(-1), sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(0), sq_entries_(0),
+                       sqes_(nullptr), cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(0), cqes_(nullptr),
+                       ring_ptr_(nullptr), ring_size_(0), sqes_size_(0), bufs_(nullptr) {}
+
+Io_uring::~Io_uring() = default;
+
+bool Io_uring::set_up() { return false; }
+
+void Io_uring::bind_thread() {}
+
+void Io_uring::accept_multishot(int listen_fd, uint64_t user_data) {}
+
+void Io_uring::poll(int fd, uint32_t events, uint64_t user_data, bool multishot) {}
+
+void Io_uring::recv(int fd, uint64_t user_data) {}
+
+void Io_uring::submit() {}
+
+int Io_uring::wait(Uring_event* events, int max) { return 0; }
+
+void Io_uring::recycle(uint16_t id) {}
+
+#endif
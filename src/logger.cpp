@@ -0,0 +1,231 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <ctime>
+#include <thread>
+#include <algorithm>
+#include <cstdarg>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "logger.h"
+
+static const char* level_names[] = {"error", "warn", "info", "debug"};
+
+// records start on 8 byte boundaries, so a header never straddles the end of the ring
+static size_t record_size(size_t len) {
+    return (8 + len + 7) & ~(size_t) 7;
+}
+
+// a header with this length tells the reader the next record starts at the beginning of the ring
+#define RECORD_WRAP UINT32_MAX
+
+Log_ring::Log_ring() : buf_(new char[LOG_RING_SIZE]), head_(0), tail_(0), next(nullptr) {}
+
+bool Log_ring::push(Log_sink sink, const char* data, size_t len) {
+    size_t head = head_.load(std::memory_order_acquire);
+    size_t tail = tail_.load(std::memory_order_relaxed);
+    size_t size = record_size(len);
+    size_t offset = tail % LOG_RING_SIZE;
+    size_t to_end = LOG_RING_SIZE - offset;
+    // a record is never split, the rest of the ring is skipped when it doesn't fit there
+    size_t skip = to_end < size ? to_end : 0;
+    if (LOG_RING_SIZE - (tail - head) < skip + size)
+        return false;
+    if (skip > 0){
+        Record wrap{RECORD_WRAP, 0};
+        memcpy(buf_ + offset, &wrap, sizeof(wrap));
+        tail += skip;
+        offset = 0;
+    }
+    Record record{(uint32_t) len, (uint32_t) sink};
+    memcpy(buf_ + offset, &record, sizeof(record));
+    memcpy(buf_ + offset + sizeof(record), data, len);
+    tail_.store(tail + size, std::memory_order_release);
+    return true;
+}
+
+template<typename Out>
+size_t Log_ring::pop_all(Out out) {
+    size_t head = head_.load(std::memory_order_relaxed);
+    size_t tail = tail_.load(std::memory_order_acquire);
+    size_t nums = 0;
+    while (head != tail){
+        size_t offset = head % LOG_RING_SIZE;
+        Record record{};
+        memcpy(&record, buf_ + offset, sizeof(record));
+        if (record.len == RECORD_WRAP){
+            head += LOG_RING_SIZE - offset;
+            continue;
+        }
+        out((int) record.sink, buf_ + offset + sizeof(record), (size_t) record.len);
+        head += record_size(record.len);
+        nums++;
+    }
+    head_.store(head, std::memory_order_release);
+    return nums;
+}
+
+Logger::Logger() : level_(LOG_INFO), reopen_(false), dropped_(0), rings_(nullptr), access_on_(true),
+                   fds_{STDOUT_FILENO, STDERR_FILENO}, sizes_{0, 0}, rotate_size_(LOG_ROTATE_DEFAULT_SIZE) {}
+
+Logger& Logger::instance() {
+    static Logger logger;
+    return logger;
+}
+
+void Logger::set_access_path(const char* path) {
+    paths_[SINK_ACCESS] = strcmp(path, "-") == 0 ? "" : path;
+    access_on_ = paths_[SINK_ACCESS] != "off";
+}
+
+void Logger::set_error_path(const char* path) {
+    paths_[SINK_ERROR] = strcmp(path, "-") == 0 ? "" : path;
+}
+
+void Logger::set_rotate_size(long size) {
+    rotate_size_ = size;
+}
+
+void Logger::set_level(int level) {
+    level_.store(std::max((int) LOG_ERROR, std::min(level, (int) LOG_DEBUG)), std::memory_order_relaxed);
+}
+
+// the ring of the calling thread, made and linked in the first time the thread logs, rings are never freed
+Log_ring& Logger::ring() {
+    static thread_local Log_ring* ring = nullptr;
+    if (ring == nullptr){
+        ring = new Log_ring();
+        Log_ring* head = rings_.load(std::memory_order_relaxed);
+        do {
+            ring->next = head;
+        } while (!rings_.compare_exchange_weak(head, ring, std::memory_order_release, std::memory_order_relaxed));
+    }
+    return *ring;
+}
+
+void Logger::log(Log_level level, const char* fmt, ...) {
+    char line[LOG_LINE_MAX];
+    int len = snprintf(line, sizeof(line), "%s [%s] ", log_time(), level_names[level]);
+    va_list args;
+    va_start(args, fmt);
+    int num = vsnprintf(line + len, sizeof(line) - len - 1, fmt, args);
+    va_end(args);
+    len = num < 0 ? len : std::min(len + num, (int) sizeof(line) - 2);
+    line[len++] = '\n';
+    if (!ring().push(SINK_ERROR, line, len))
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Logger::access(const char* line, size_t len) {
+    if (!ring().push(SINK_ACCESS, line, std::min(len, (size_t) LOG_LINE_MAX)))
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Logger::open_sink(int sink) {
+    if (paths_[sink].empty() || paths_[sink] == "off")
+        return;
+    int fd = open(paths_[sink].c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1){
+        perror("ERROR: open log file failed\n");
+        return;
+    }
+    if (fds_[sink] > STDERR_FILENO)
+        close(fds_[sink]);
+    fds_[sink] = fd;
+    off_t size = lseek(fd, 0, SEEK_END);
+    sizes_[sink] = size > 0 ? size : 0;
+}
+
+// a file grown past rotate_size_ is renamed to <path>.1, replacing the previous one, and started over
+void Logger::write_sink(int sink, const char* data, size_t len) {
+    if (len == 0 || paths_[sink] == "off")
+        return;
+    while (len > 0){
+        ssize_t num_written = write(fds_[sink], data, len);
+        if (num_written < 0){
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        data += num_written;
+        len -= num_written;
+        sizes_[sink] += num_written;
+    }
+    if (rotate_size_ > 0 && !paths_[sink].empty() && sizes_[sink] >= (size_t) rotate_size_){
+        std::string rotated = paths_[sink] + ".1";
+        rename(paths_[sink].c_str(), rotated.c_str());
+        open_sink(sink);
+    }
+}
+
+void Logger::on_signal(int signal) {
+    Logger& logger = instance();
+    int level = logger.level_.load(std::memory_order_relaxed);
+    if (signal == SIGUSR1)
+        logger.set_level(level + 1);
+    else if (signal == SIGUSR2)
+        logger.set_level(level - 1);
+    else
+        logger.reopen_.store(true, std::memory_order_relaxed);
+}
+
+void Logger::start() {
+    for (int sink = 0; sink < SINK_NUMS; sink++)
+        open_sink(sink);
+    struct sigaction action{};
+    action.sa_handler = on_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, nullptr);
+    sigaction(SIGUSR2, &action, nullptr);
+    sigaction(SIGHUP, &action, nullptr);
+    std::thread(&Logger::write_loop, this).detach();
+}
+
+// gather the records of every ring into one buffer per sink, write a buffer whenever it is full
+// and whatever is left once all rings are empty
+void Logger::write_loop() {
+    static char batches[SINK_NUMS][LOG_BATCH_SIZE];
+    size_t used[SINK_NUMS] = {};
+    while (true){
+        if (reopen_.exchange(false, std::memory_order_relaxed)){
+            for (int sink = 0; sink < SINK_NUMS; sink++)
+                open_sink(sink);
+        }
+        size_t nums = 0;
+        for (Log_ring* ring = rings_.load(std::memory_order_acquire); ring != nullptr; ring = ring->next){
+            nums += ring->pop_all([this, &used](int sink, const char* data, size_t len){
+                if (used[sink] + len > LOG_BATCH_SIZE){
+                    write_sink(sink, batches[sink], used[sink]);
+                    used[sink] = 0;
+                }
+                memcpy(batches[sink] + used[sink], data, len);
+                used[sink] += len;
+            });
+        }
+        for (int sink = 0; sink < SINK_NUMS; sink++){
+            write_sink(sink, batches[sink], used[sink]);
+            used[sink] = 0;
+        }
+        if (nums == 0)
+            usleep(LOG_FLUSH_MS * 1000);
+    }
+}
+
+const char* log_time() {
+    static thread_local time_t second = 0;
+    static thread_local char text[32];
+    struct timespec now{};
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    if (now.tv_sec != second){
+        struct tm gmt{};
+        gmtime_r(&now.tv_sec, &gmt);
+        strftime(text, sizeof(text), "[%d/%b/%Y:%H:%M:%S +0000]", &gmt);
+        second = now.tv_sec;
+    }
+    return text;
+}
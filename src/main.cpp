@@ -1,10 +1,93 @@
 #include <iostream>
+#include <getopt.h>
 #include "httpd_handler.h"
 #include "httpd.h"
+#include "logger.h"
 
-int main() {
-    Httpd httpd;
+void usage(const char* name) {
+    printf("usage: %s [-p port] [-r reactors] [-w workers] [-c cache_kb] [-f fcgi_workers] [-b body_kb]\n"
+           "       [-a access_log] [-e error_log] [-l level] [-m rotate_mb] [-i events]\n", name);
+    printf("  -p port      listening port, 0 for a random one (default 8081)\n");
+    printf("  -r reactors  number of epoll reactors sharing the port with SO_REUSEPORT, 0 for one per core (default 1)\n");
+    printf("  -w workers   worker threads per reactor, 0 to handle requests in the reactor thread\n");
+    printf("               (default one per core with a single reactor, 0 with several reactors)\n");
+    printf("  -c cache_kb  byte budget of the static file cache in KB, 0 to disable (default %d)\n", FILE_CACHE_DEFAULT_SIZE >> 10);
+    printf("  -f fcgi_workers  persistent FastCGI processes per .fcgi script, 0 to run them as plain CGI (default %d)\n",
+           FCGI_DEFAULT_WORKERS);
+    printf("  -b body_kb   largest request body in KB, bigger ones get 413 (default %ld)\n", MAX_BODY_SIZE >> 10);
+    printf("  -a access_log  access log file in the Combined Log Format, - for stdout, off for none (default -)\n");
+    printf("  -e error_log   log file of everything else, - for stderr (default -)\n");
+    printf("  -l level     error, warn, info or debug (default info), SIGUSR1 and SIGUSR2 raise and lower it while running\n");
+    printf("  -m rotate_mb  log files are renamed to <file>.1 at this size, 0 to leave it to SIGHUP (default %ld)\n",
+           LOG_ROTATE_DEFAULT_SIZE >> 20);
+    printf("  -i events    uring or epoll, uring falls back to epoll where the kernel lacks it (default uring)\n");
+}
+
+// a level name or its number
+int log_level(const char* name) {
+    static const char* names[] = {"error", "warn", "info", "debug"};
+    for (int i = 0; i <= LOG_DEBUG; i++){
+        if (strcmp(name, names[i]) == 0)
+            return i;
+    }
+    return atoi(name);
+}
+
+int main(int argc, char* argv[]) {
     u_short port = 8081;
-    printf("starting up httpd at port:%d\n", port);
-    httpd.start_up(port);
+    int reactor_nums = 1;
+    int worker_nums = -1;
+    int opt;
+    Logger& logger = Logger::instance();
+    while ((opt = getopt(argc, argv, "p:r:w:c:f:b:a:e:l:m:i:h")) != -1){
+        switch (opt){
+            case 'p':
+                port = (u_short) atoi(optarg);
+                break;
+            case 'r':
+                reactor_nums = atoi(optarg);
+                break;
+            case 'w':
+                worker_nums = atoi(optarg);
+                break;
+            case 'c':
+                File_cache::instance().set_capacity((size_t) atol(optarg) << 10);
+                break;
+            case 'f':
+                Fcgi_pool::instance().set_max_workers((size_t) atol(optarg));
+                break;
+            case 'b':
+                Httpd_handler::set_max_body(atol(optarg) << 10);
+                break;
+            case 'a':
+                logger.set_access_path(optarg);
+                break;
+            case 'e':
+                logger.set_error_path(optarg);
+                break;
+            case 'l':
+                logger.set_level(log_level(optarg));
+                break;
+            case 'm':
+                logger.set_rotate_size(atol(optarg) << 20);
+                break;
+            case 'i':
+                Httpd::set_io_uring(strcmp(optarg, "epoll") != 0);
+                break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (worker_nums < 0)
+        worker_nums = reactor_nums == 1 ? (int) std::thread::hardware_concurrency() : 0;
+
+    logger.start();
+    LOG(LOG_INFO, "starting up httpd at port:%d", port);
+    if (reactor_nums == 1){
+        Httpd httpd(worker_nums);
+        httpd.start_up(port);
+    }
+    else
+        Httpd::start_up_reactors(port, reactor_nums, worker_nums);
 }
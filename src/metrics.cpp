@@ -0,0 +1,140 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <cinttypes>
+#include "metrics.h"
+#include "logger.h"
+
+std::atomic<Metrics_shard*> Metrics::shards_{nullptr};
+
+Metrics_histogram::Metrics_histogram() : count_(0), sum_(0) {
+    for (std::atomic<uint64_t>& bucket : buckets_)
+        bucket.store(0, std::memory_order_relaxed);
+}
+
+int Metrics_histogram::bucket(uint64_t value) {
+    if (value < (2u << METRICS_SUB_BITS))
+        return (int) value;
+    int shift = 63 - __builtin_clzll(value) - METRICS_SUB_BITS;
+    int index = (shift << METRICS_SUB_BITS) + (int) (value >> shift);
+    return index < METRICS_BUCKETS ? index : METRICS_BUCKETS - 1;
+}
+
+uint64_t Metrics_histogram::value(int index) {
+    if (index < (2 << METRICS_SUB_BITS))
+        return index;
+    int shift = (index >> METRICS_SUB_BITS) - 1;
+    uint64_t mantissa = (index & ((1 << METRICS_SUB_BITS) - 1)) + (1 << METRICS_SUB_BITS);
+    return (mantissa << shift) + ((1ULL << shift) >> 1);
+}
+
+void Metrics_histogram::record(uint64_t ns) {
+    std::atomic<uint64_t>& bucket = buckets_[Metrics_histogram::bucket(ns)];
+    bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    sum_.store(sum_.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+}
+
+// read while the owner records, so count and sum may be a value or two ahead of the buckets
+void Metrics_histogram::read(uint64_t* counts, uint64_t& count, uint64_t& sum) const {
+    for (int i = 0; i < METRICS_BUCKETS; i++)
+        counts[i] += buckets_[i].load(std::memory_order_relaxed);
+    count += count_.load(std::memory_order_relaxed);
+    sum += sum_.load(std::memory_order_relaxed);
+}
+
+Metrics_shard::Metrics_shard() : next(nullptr) {
+    for (std::atomic<uint64_t>& counter : counters)
+        counter.store(0, std::memory_order_relaxed);
+    for (std::atomic<uint64_t>& response : responses)
+        response.store(0, std::memory_order_relaxed);
+}
+
+Metrics_shard* Metrics::add_shard() {
+    Metrics_shard* shard = new Metrics_shard();
+    Metrics_shard* head = shards_.load(std::memory_order_relaxed);
+    do {
+        shard->next = head;
+    } while (!shards_.compare_exchange_weak(head, shard, std::memory_order_release, std::memory_order_relaxed));
+    return shard;
+}
+
+static void append_metric(std::string& out, const char* name, const char* type, const char* help) {
+    out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+}
+
+static void append_value(std::string& out, const char* name, const char* labels, uint64_t value) {
+    char line[256];
+    snprintf(line, sizeof(line), "%s%s %" PRIu64 "\n", name, labels, value);
+    out.append(line);
+}
+
+// latencies are exported as summaries, the quantiles come from the buckets of all shards merged
+static void append_summary(std::string& out, Metrics_shard* shards, Histogram_id id,
+                           const char* name, const char* help) {
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    std::vector<uint64_t> counts(METRICS_BUCKETS, 0);
+    uint64_t count = 0, sum = 0;
+    for (Metrics_shard* shard = shards; shard != nullptr; shard = shard->next)
+        shard->histograms[id].read(counts.data(), count, sum);
+    append_metric(out, name, "summary", help);
+    char line[256];
+    for (double q : quantiles){
+        uint64_t rank = std::max((uint64_t) std::ceil(q * count), (uint64_t) 1);
+        uint64_t seen = 0;
+        int i = 0;
+        while (i < METRICS_BUCKETS - 1 && (seen += counts[i]) < rank)
+            i++;
+        double seconds = count == 0 ? 0 : Metrics_histogram::value(i) / 1e9;
+        snprintf(line, sizeof(line), "%s{quantile=\"%g\"} %.9f\n", name, q, seconds);
+        out.append(line);
+    }
+    snprintf(line, sizeof(line), "%s_sum %.9f\n%s_count %" PRIu64 "\n", name, sum / 1e9, name, count);
+    out.append(line);
+}
+
+// nothing is locked, every value is read as the thread counting it has last written it
+std::string Metrics::prometheus() {
+    Metrics_shard* shards = shards_.load(std::memory_order_acquire);
+    uint64_t counters[COUNTER_NUMS] = {};
+    uint64_t responses[STATUS_ID_NUMS + 1] = {};
+    for (Metrics_shard* shard = shards; shard != nullptr; shard = shard->next){
+        for (int i = 0; i < COUNTER_NUMS; i++)
+            counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+        for (int i = 0; i <= STATUS_ID_NUMS; i++)
+            responses[i] += shard->responses[i].load(std::memory_order_relaxed);
+    }
+
+    std::string out;
+    append_metric(out, "httpd_connections_accepted_total", "counter", "Connections accepted.");
+    append_value(out, "httpd_connections_accepted_total", "", counters[COUNTER_ACCEPTED]);
+    // a connection may be closed by another thread than the one that accepted it, only the sums match up
+    append_metric(out, "httpd_connections_active", "gauge", "Connections open right now.");
+    append_value(out, "httpd_connections_active", "", counters[COUNTER_ACCEPTED] - counters[COUNTER_CLOSED]);
+    append_metric(out, "httpd_sent_bytes_total", "counter", "Bytes written to client sockets.");
+    append_value(out, "httpd_sent_bytes_total", "", counters[COUNTER_BYTES_SENT]);
+    append_metric(out, "httpd_cgi_spawned_total", "counter", "CGI and FastCGI processes started.");
+    append_value(out, "httpd_cgi_spawned_total", "", counters[COUNTER_CGI_SPAWNED]);
+    append_metric(out, "httpd_log_dropped_total", "counter", "Log records dropped because a ring was full.");
+    append_value(out, "httpd_log_dropped_total", "", Logger::instance().dropped());
+    append_metric(out, "httpd_responses_total", "counter", "Responses by status code.");
+    char labels[32];
+    for (int i = 0; i < STATUS_ID_NUMS; i++){
+        snprintf(labels, sizeof(labels), "{code=\"%d\"}", http_status((Status_id) i).code);
+        append_value(out, "httpd_responses_total", labels, responses[i]);
+    }
+    append_value(out, "httpd_responses_total", "{code=\"other\"}", responses[STATUS_ID_NUMS]);
+    append_summary(out, shards, HISTOGRAM_PARSE, "httpd_parse_seconds",
+                   "Time to parse a request head once it is complete.");
+    append_summary(out, shards, HISTOGRAM_FIRST_BYTE, "httpd_first_byte_seconds",
+                   "Time from a parsed request to the first byte of its response on the socket.");
+    append_summary(out, shards, HISTOGRAM_CGI_SPAWN, "httpd_cgi_spawn_seconds",
+                   "Time to start a CGI child or a FastCGI worker.");
+    return out;
+}
@@ -0,0 +1,166 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include "output_queue.h"
+
+Output_queue::~Output_queue() {
+    clear();
+}
+
+void Output_queue::append(const char* data, size_t len) {
+    if (len == 0)
+        return;
+    if (chunks_.empty() || !chunks_.back().copied()){
+        chunks_.emplace_back();
+        chunks_.back().bytes.swap(spare_);
+    }
+    Chunk& chunk = chunks_.back();
+    chunk.bytes.append(data, len);
+    chunk.left += len;
+    pending_ += len;
+    appended_ += len;
+}
+
+void Output_queue::append(const std::shared_ptr<const std::string>& data) {
+    if (data->empty())
+        return;
+    chunks_.emplace_back();
+    Chunk& chunk = chunks_.back();
+    chunk.shared = data;
+    chunk.left = data->size();
+    pending_ += data->size();
+    appended_ += data->size();
+}
+
+void Output_queue::append_static(const char* data, size_t len) {
+    if (len == 0)
+        return;
+    chunks_.emplace_back();
+    Chunk& chunk = chunks_.back();
+    chunk.fixed = data;
+    chunk.left = len;
+    pending_ += len;
+    appended_ += len;
+}
+
+void Output_queue::append_file(int file_fd, off_t offset, size_t len) {
+    if (len == 0){
+        close(file_fd);
+        return;
+    }
+    chunks_.emplace_back();
+    Chunk& chunk = chunks_.back();
+    chunk.file_fd = file_fd;
+    chunk.offset = offset;
+    chunk.left = len;
+    pending_ += len;
+    appended_ += len;
+}
+
+void Output_queue::append_pipe(int pipe_fd, size_t len) {
+    if (len == 0)
+        return;
+    chunks_.emplace_back();
+    Chunk& chunk = chunks_.back();
+    chunk.file_fd = pipe_fd;
+    chunk.pipe = true;
+    chunk.left = len;
+    pending_ += len;
+    appended_ += len;
+}
+
+// drop the memory chunks fully sent, and move into the one sent partially
+void Output_queue::consume(size_t num_sent) {
+    pending_ -= num_sent;
+    while (num_sent > 0){
+        Chunk& chunk = chunks_.front();
+        if (num_sent < chunk.left){
+            chunk.sent += num_sent;
+            chunk.left -= num_sent;
+            return;
+        }
+        num_sent -= chunk.left;
+        recycle(chunk);
+        chunks_.pop_front();
+    }
+}
+
+// keep the bigger buffer of chunk and spare_, emptied, unless it is too big to keep around
+void Output_queue::recycle(Chunk& chunk) {
+    size_t capacity = chunk.bytes.capacity();
+    if (chunk.copied() && capacity > spare_.capacity() && capacity <= OUTPUT_SPARE_SIZE){
+        chunk.bytes.clear();
+        spare_.swap(chunk.bytes);
+    }
+}
+
+Output_queue::Result Output_queue::flush(int socket) {
+    while (!chunks_.empty()){
+        Chunk& front = chunks_.front();
+        ssize_t num_sent;
+        if (front.file_fd != -1){
+            // more is only hinted when something follows, otherwise the last segment would wait for it
+            if (front.pipe)
+                num_sent = splice(front.file_fd, nullptr, socket, nullptr, front.left,
+                                  SPLICE_F_MOVE | SPLICE_F_NONBLOCK | (chunks_.size() > 1 ? SPLICE_F_MORE : 0));
+            else
+                num_sent = sendfile(socket, front.file_fd, &front.offset, front.left);
+            // the file shrank under us, the promised Content-Length can't be kept
+            if (num_sent == 0)
+                return ERROR;
+            if (num_sent > 0){
+                pending_ -= num_sent;
+                front.left -= num_sent;
+                if (front.left == 0){
+                    if (!front.pipe)
+                        close(front.file_fd);
+                    chunks_.pop_front();
+                }
+                continue;
+            }
+        }
+        else{
+            // gather the memory chunks up to the next file into one call
+            // a header followed by a file goes out with MSG_MORE, so it shares a segment with the file's start
+            struct iovec iov[OUTPUT_MAX_IOV];
+            int iov_nums = 0;
+            int flags = 0;
+            for (const Chunk& chunk : chunks_){
+                if (chunk.file_fd != -1){
+                    flags = MSG_MORE;
+                    break;
+                }
+                if (iov_nums == OUTPUT_MAX_IOV)
+                    break;
+                iov[iov_nums].iov_base = (void*) chunk.data();
+                iov[iov_nums].iov_len = chunk.left;
+                iov_nums++;
+            }
+            struct msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iov_nums;
+            num_sent = sendmsg(socket, &msg, flags);
+            if (num_sent >= 0){
+                consume(num_sent);
+                continue;
+            }
+        }
+        if (errno == EINTR)
+            continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return AGAIN;
+        return ERROR;
+    }
+    return DONE;
+}
+
+void Output_queue::clear() {
+    for (Chunk& chunk : chunks_){
+        if (chunk.file_fd != -1 && !chunk.pipe)
+            close(chunk.file_fd);
+        recycle(chunk);
+    }
+    chunks_.clear();
+    pending_ = 0;
+}
@@ -0,0 +1,54 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include "thread_pool.h"
+
+Thread_pool::Thread_pool(int thread_nums) : stop_(false) {
+    if (thread_nums <= 0)
+        thread_nums = (int) std::thread::hardware_concurrency();
+    // hardware_concurrency() is allowed to return 0 when it can't tell
+    if (thread_nums <= 0)
+        thread_nums = 1;
+    for (int i = 0; i < thread_nums; i++)
+        workers_.emplace_back(&Thread_pool::work, this);
+}
+
+// let the workers drain the queue, then join them
+Thread_pool::~Thread_pool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cond_.notify_all();
+    for (auto& worker : workers_)
+        worker.join();
+}
+
+void Thread_pool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push(std::move(task));
+    }
+    cond_.notify_one();
+}
+
+int Thread_pool::size() const {
+    return (int) workers_.size();
+}
+
+// worker main loop, sleep until there is a task or the pool is stopping
+void Thread_pool::work() {
+    while (true){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this]{ return stop_ || !tasks_.empty(); });
+            if (stop_ && tasks_.empty())
+                return;
+            task = std::move(tasks_.front());
+            tasks_.pop();
+        }
+        task();
+    }
+}
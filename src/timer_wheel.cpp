@@ -0,0 +1,65 @@
+//
+// Created by agent on 2026/10/17.
+//
+
+#include "timer_wheel.h"
+
+Timer_wheel::Timer_wheel() : current_(now()), size_(0) {
+    for (Timer& slot : slots_)
+        slot.prev = slot.next = &slot;
+}
+
+void Timer_wheel::unlink(Timer* timer) {
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = nullptr;
+}
+
+void Timer_wheel::add(Timer* timer, long expire) {
+    if (timer->armed())
+        remove(timer);
+    // a deadline already passed goes to the next tick
+    if (expire <= current_)
+        expire = current_ + 1;
+    timer->expire = expire;
+    Timer* slot = &slots_[expire % TIMER_WHEEL_SLOTS];
+    timer->prev = slot->prev;
+    timer->next = slot;
+    slot->prev->next = timer;
+    slot->prev = timer;
+    size_++;
+}
+
+void Timer_wheel::remove(Timer* timer) {
+    if (!timer->armed())
+        return;
+    unlink(timer);
+    size_--;
+}
+
+void Timer_wheel::advance(long now, std::vector<int>& expired) {
+    if (now <= current_)
+        return;
+    // after a long pause every slot is due once, no need to go round several times
+    long from = now - current_ > TIMER_WHEEL_SLOTS ? now - TIMER_WHEEL_SLOTS + 1 : current_ + 1;
+    for (long second = from; second <= now && size_ > 0; second++){
+        Timer* slot = &slots_[second % TIMER_WHEEL_SLOTS];
+        Timer* timer = slot->next;
+        while (timer != slot){
+            Timer* next = timer->next;
+            if (timer->expire <= now){
+                unlink(timer);
+                size_--;
+                expired.push_back(timer->fd);
+            }
+            timer = next;
+        }
+    }
+    current_ = now;
+}
+
+long Timer_wheel::now() {
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}